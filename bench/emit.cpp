@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "Parser.h"
+
+/*
+	Benchmark of emitting the three-address code to a file: line by line
+	through std::ostream and std::endl, as the compiler used to do, against
+	the buffered file sink and the memory sink
+
+	Usage: bench_emit [statements] [repeats]
+*/
+
+// Writes a program of n array assignments in the body of a loop
+static void program(const char* filename, int n) {
+	std::ofstream os(filename);
+	os << "{\n\tint[100][100] a; int i; int j;\n\ti = 0;\n\twhile (i < 100) {\n\t\tj = 0;\n";
+	for (int k = 0; k < n; k++) os << "\t\ta[i][j] = a[i][j] + a[j][i] * " << k << ";\n\t\tj = j + 1;\n";
+	os << "\t\ti = i + 1;\n\t}\n}\n";
+}
+
+template<class F>
+static double measure(F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+	int statements = argc > 1 ? std::atoi(argv[1]) : 10000;
+	int repeats = argc > 2 ? std::atoi(argv[2]) : 50;
+	const char* input = "bench_emit.txt";
+	const char* output = "bench_emit.out";
+
+	program(input, statements);
+	Context ctx;
+	{
+		std::shared_ptr<Lexer> l = std::make_shared<Lexer>(input);
+		std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
+		p->gen(ctx, p->program());
+	}
+	double instructions = (double)ctx.code.quads.size() * repeats;
+
+	auto report = [&](const char* name, double seconds) {
+		std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << seconds << " s" << std::setw(14) << std::setprecision(0) << instructions / seconds << " instructions/s" << std::endl;
+	};
+	std::cout << (size_t)instructions << " instructions" << std::endl;
+
+	report("endl", measure([&] {
+		std::ofstream os(output);
+		MemorySink line;
+		for (int r = 0; r < repeats; r++) {
+			for (Quad& q : ctx.code.quads) {
+				line.clear();
+				ctx.code.format(q, line);
+				if (line.data()[line.size() - 1] != '\n') { os.write(line.data(), line.size()); continue; }
+				os.write(line.data(), line.size() - 1) << std::endl;
+			}
+		}
+	}));
+
+	report("FileSink", measure([&] {
+		FileSink out(output);
+		for (int r = 0; r < repeats; r++) ctx.code.print(out);
+		out.flush();
+	}));
+
+	report("MemorySink", measure([&] {
+		MemorySink out;
+		for (int r = 0; r < repeats; r++) {
+			out.clear();
+			ctx.code.print(out);
+		}
+	}));
+
+	std::remove(input);
+	std::remove(output);
+	return 0;
+}
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "Parser.h"
+#include "Interpreter.h"
+#include "Passes.h"
+
+/*
+	Benchmark of the loop optimizations on array loops. Each program is
+	interpreted as generated, with only the invariants hoisted, and under
+	the -O passes without and with the hoisting, counting the instructions
+	and the multiplications executed
+
+	Usage: bench_loops [size]
+*/
+
+struct Program {
+	const char* name;
+	std::string source;
+};
+
+static std::vector<Program> programs(int n) {
+	std::string size = std::to_string(n);
+	std::vector<Program> list;
+	list.push_back({ "while 1d", "{\n\tint i; int[" + size + "] a; int[" + size + "] b; int[" + size + "] c;\n"
+		"\ti = 0;\n\twhile (i < " + size + ") { c[i] = a[i] + b[i]; i = i + 1; }\n}\n" });
+	list.push_back({ "while 2d", "{\n\tint i; int j; int[" + size + "][" + size + "] a;\n"
+		"\ti = 0;\n\twhile (i < " + size + ") {\n\t\tj = 0;\n"
+		"\t\twhile (j < " + size + ") { a[i][j] = a[i][j] + i * j; j = j + 1; }\n"
+		"\t\ti = i + 1;\n\t}\n}\n" });
+	list.push_back({ "do 2d", "{\n\tint i; int j; int[" + size + "][" + size + "] a; int[" + size + "] b;\n"
+		"\ti = 0;\n\tdo {\n\t\tj = 0;\n"
+		"\t\tdo { a[j][i] = b[i] * 3 + j; j = j + 1; } while (j < " + size + ");\n"
+		"\t\ti = i + 1;\n\t} while (i < " + size + ");\n}\n" });
+	list.push_back({ "add 2d", "{\n\tint i; int j; int[" + size + "][" + size + "] a; int[" + size + "][" + size + "] b; int[" + size + "][" + size + "] c;\n"
+		"\ti = 0;\n\twhile (i < " + size + ") {\n\t\tj = 0;\n"
+		"\t\twhile (j < " + size + ") { a[i][j] = b[i][j] * 3 + c[i][j]; j = j + 1; }\n"
+		"\t\ti = i + 1;\n\t}\n}\n" });
+	list.push_back({ "while 3d", "{\n\tint i; int j; int k; int m; int[" + size + "][" + size + "] a; int[" + size + "][" + size + "] c;\n"
+		"\tm = " + size + "; i = 0;\n\twhile (i < m) {\n\t\tj = 0;\n\t\twhile (j < m) {\n\t\t\tk = 0;\n"
+		"\t\t\twhile (k < m) { c[i][j] = c[i][j] + a[i][k] * a[k][j] + (i + j) * m; k = k + 1; }\n"
+		"\t\t\tj = j + 1;\n\t\t}\n\t\ti = i + 1;\n\t}\n}\n" });
+	return list;
+}
+
+static Interpreter interpret(const Code& code) {
+	Interpreter interpreter(code);
+	interpreter.run();
+	return interpreter;
+}
+
+static Code generate(const std::string& source) {
+	const char* input = "bench_loops.txt";
+	{ std::ofstream os(input); os << source; }
+	Context ctx;
+	std::shared_ptr<Lexer> l = std::make_shared<Lexer>(input);
+	std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
+	p->gen(ctx, p->program());
+	std::remove(input);
+	return ctx.code;
+}
+
+static void optimize(Code& code, bool licm) {
+	Passes passes(Passes::Levels, false);
+	if (!licm) passes.skip("licm");
+	passes.run(code);
+}
+
+int main(int argc, char* argv[]) {
+	int size = argc > 1 ? std::atoi(argv[1]) : 40;
+
+	std::cout << std::setw(10) << "program" << std::setw(12) << "plain" << std::setw(12) << "licm"
+		<< std::setw(12) << "-O no licm" << std::setw(12) << "-O" << std::setw(10) << "saved"
+		<< std::setw(12) << "muls plain" << std::setw(10) << "muls -O" << std::endl;
+	for (const Program& program : programs(size)) {
+		Code code = generate(program.source);
+		Code hoisted = code, optimized = code, all = code;
+		Analyses analyses(hoisted);
+		Licm::run(hoisted, analyses);
+		optimize(optimized, false);
+		optimize(all, true);
+
+		Interpreter plain = interpret(code), last = interpret(all);
+		size_t before = interpret(optimized).steps, after = last.steps;
+		std::cout << std::setw(10) << program.name << std::setw(12) << plain.steps << std::setw(12) << interpret(hoisted).steps
+			<< std::setw(12) << before << std::setw(12) << after << std::fixed << std::setprecision(1)
+			<< std::setw(9) << 100 * ((double)before - after) / before << '%'
+			<< std::setw(12) << plain.counts[(size_t)Opcode::Mul] << std::setw(10) << last.counts[(size_t)Opcode::Mul] << std::endl;
+	}
+	return 0;
+}
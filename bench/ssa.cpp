@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "Parser.h"
+#include "SSA.h"
+
+/*
+	Benchmark of the construction of SSA form and of the translation out
+	of it on programs of growing size, the time per block should stay flat
+
+	Usage: bench_ssa [statements] [doublings]
+*/
+
+// Writes a loop over n conditional assignments, each a join point of the
+// variables it assigns
+static void program(const char* filename, int n) {
+	std::ofstream os(filename);
+	os << "{\n\tint i; int j; int k; int m;\n\ti = 0; j = 0; k = 0; m = 0;\n\twhile (i < 100) {\n";
+	for (int s = 0; s < n; s++) {
+		os << "\t\tif (j < " << s << ") j = j + k; else k = k - m;\n";
+		if (s % 3 == 0) os << "\t\tm = m + j;\n";
+	}
+	os << "\t\ti = i + 1;\n\t}\n}\n";
+}
+
+template<class F>
+static double measure(F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+	int statements = argc > 1 ? std::atoi(argv[1]) : 2500;
+	int doublings = argc > 2 ? std::atoi(argv[2]) : 4;
+	const char* input = "bench_ssa.txt";
+
+	std::cout << std::setw(10) << "blocks" << std::setw(10) << "phis" << std::setw(14) << "build ms"
+		<< std::setw(14) << "leave ms" << std::setw(14) << "ns/block" << std::endl;
+	for (int d = 0; d < doublings; d++, statements *= 2) {
+		program(input, statements);
+		Context ctx;
+		std::shared_ptr<Lexer> l = std::make_shared<Lexer>(input);
+		std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
+		p->gen(ctx, p->program());
+
+		std::unique_ptr<SSA> ssa;
+		double build = measure([&] { ssa = std::make_unique<SSA>(ctx.code); });
+		size_t blocks = ssa->cfg.blocks.size(), phis = 0;
+		for (auto& b : ssa->phis) phis += b.size();
+		double leave = measure([&] { ssa->leave(); });
+
+		std::cout << std::setw(10) << blocks << std::setw(10) << phis << std::fixed << std::setprecision(1)
+			<< std::setw(14) << build * 1e3 << std::setw(14) << leave * 1e3
+			<< std::setw(14) << (build + leave) * 1e9 / blocks << std::endl;
+	}
+
+	std::remove(input);
+	return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "Liveness.h"
+#include "Loops.h"
+#include <memory>
+
+/*
+	Analyses of the code shared by the passes. Each is computed when first
+	asked for and kept until a pass invalidates it: a pass changing the
+	code drops the analyses it no longer holds for, and with the graph go
+	the dominators, loops and liveness computed from it
+*/
+class Analyses {
+public:
+	enum Kind { Graph = 1, Tree = 2, Nest = 4, Live = 8, All = 15 };
+
+	int built = 0; // Analyses computed
+
+	Analyses(const Code& c) : code(c) {}
+
+	const CFG& cfg() {
+		if (graph == nullptr) { graph = std::make_unique<CFG>(code); built++; }
+		return *graph;
+	}
+
+	const Dominators& dom() {
+		if (tree == nullptr) { tree = std::make_unique<Dominators>(cfg()); built++; }
+		return *tree;
+	}
+
+	const Loops& loops() {
+		if (nest == nullptr) { nest = std::make_unique<Loops>(cfg(), dom()); built++; }
+		return *nest;
+	}
+
+	const Liveness& live() {
+		if (alive == nullptr) { alive = std::make_unique<Liveness>(code, cfg()); built++; }
+		return *alive;
+	}
+
+	// Drops the analyses of the kinds given and the ones depending on them.
+	// A pass moving, adding or removing instructions changes the graph
+	void invalidate(int kinds) {
+		if (kinds & Graph) kinds |= Tree | Live;
+		if (kinds & Tree) kinds |= Nest;
+		if (kinds & Graph) graph.reset();
+		if (kinds & Tree) tree.reset();
+		if (kinds & Nest) nest.reset();
+		if (kinds & Live) alive.reset();
+	}
+
+private:
+	const Code& code;
+	std::unique_ptr<CFG> graph;
+	std::unique_ptr<Dominators> tree;
+	std::unique_ptr<Loops> nest;
+	std::unique_ptr<Liveness> alive;
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include "SSA.h"
+#include <climits>
+
+/*
+	Range analysis of the integer names on the SSA form, proving that the
+	offsets of loads and stores fall within their arrays. The range of a
+	name is an interval, built from the constants through the arithmetic.
+	A conditional jump narrows the ranges of its operands on each of its
+	edges, in the blocks the edge leads to alone and in the phi arguments
+	it carries, which bounds the counters of loops by their tests. The
+	ranges grow until they settle, a phi that keeps growing is widened to
+	the next constant of the code on that side, or to no bound past them
+	all, and the tests then narrow it back. Each access not proven gets a
+	check ahead of it
+*/
+class Bounds {
+public:
+	static const int Widen = 2; // Times a phi grows before it is widened
+	static const int Narrow = 4; // Walks narrowing the ranges at most
+
+	// Returns the number of accesses proven within their array, counts the
+	// checks inserted in checks
+	static int run(Code& code, Analyses& analyses, int& checks) {
+		if (code.quads.empty()) return 0;
+		Code form = code;
+		SSA ssa(form, analyses);
+		Bounds pass(form, ssa);
+		while (pass.walk(false));
+		for (int k = 0; k < Narrow && pass.walk(true); k++);
+
+		std::vector<char> reachable(code.quads.size(), 0);
+		for (int b : ssa.dom.order) {
+			for (int i = ssa.cfg.blocks[b].begin; i < ssa.cfg.blocks[b].end; i++) reachable[i] = 1;
+		}
+		std::vector<Quad> result;
+		int proven = 0;
+		for (size_t i = 0; i < code.quads.size(); i++) {
+			const Quad& q = code.quads[i];
+			if ((q.op == Opcode::Load || q.op == Opcode::Store) && reachable[i]) {
+				int array = q.op == Opcode::Load ? q.src1 : q.dest, offset = q.op == Opcode::Load ? q.src2 : q.src1;
+				const Quad& named = form.quads[i];
+				if (pass.within(array, q.op == Opcode::Load ? named.src2 : named.src1)) proven++;
+				else {
+					result.push_back(Quad(Opcode::Check, Quad::None, array, offset));
+					checks++;
+				}
+			}
+			result.push_back(q);
+		}
+		if (result.size() == code.quads.size()) return proven;
+		code.quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return proven;
+	}
+
+private:
+	// Values a name may hold, none if lo > hi
+	struct Range { long long lo, hi; };
+
+	static constexpr long long Low = INT_MIN, High = INT_MAX;
+
+	Code& code;
+	SSA& ssa;
+	const CFG& cfg;
+	std::vector<Range> range;
+	std::vector<int> grown; // Times each phi grew
+	std::vector<long long> steps; // Bounds a phi is widened to, by value
+	std::vector<std::vector<std::vector<Range> > > incoming; // Argument of each phi of each block on each edge
+
+	Bounds(Code& c, SSA& s) : code(c), ssa(s), cfg(s.cfg) {
+		size_t n = code.operands.size();
+		range.assign(n, { Low, High });
+		grown.assign(n, 0);
+		for (size_t x = 0; x < n; x++) {
+			int c;
+			if (!code.integer((int)x, c)) continue;
+			range[x] = { c, c };
+			for (long long k = c - 1; k <= c + 1; k++) steps.push_back(k);
+		}
+		std::sort(steps.begin(), steps.end());
+		incoming.resize(cfg.blocks.size());
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int d = code.quads[i].def();
+				if (d != Quad::None && integral(d)) range[d] = { High, Low };
+			}
+			for (const SSA::Phi& phi : ssa.phis[b]) {
+				if (integral(phi.dest)) range[phi.dest] = { High, Low };
+				incoming[b].push_back(std::vector<Range>(cfg.predecessors(b).size(), { High, Low }));
+			}
+		}
+	}
+
+	bool integral(int x) const { return code.operands[x].type == Type::Int || code.operands[x].type == Type::Char; }
+
+	static bool none(Range r) { return r.lo > r.hi; }
+
+	static Range join(Range a, Range b) {
+		if (none(a)) return b;
+		if (none(b)) return a;
+		return { std::min(a.lo, b.lo), std::max(a.hi, b.hi) };
+	}
+
+	static Range meet(Range a, Range b) { return { std::max(a.lo, b.lo), std::min(a.hi, b.hi) }; }
+
+	// An interval past the integers may hold any integer
+	static Range fit(long long lo, long long hi) {
+		if (lo < Low || hi > High) return { Low, High };
+		return { lo, hi };
+	}
+
+	// Whether the offset is that of an element of the array
+	bool within(int array, int offset) const {
+		const Type& type = *code.operands[array].type;
+		Range r = range[offset];
+		return none(r) || (r.lo >= 0 && r.hi + Code::element(type) <= type.width);
+	}
+
+	Range eval(const Quad& q) const {
+		if (q.op == Opcode::Copy) return range[q.src1];
+		if (q.op != Opcode::Add && q.op != Opcode::Sub && q.op != Opcode::Mul && q.op != Opcode::Div && q.op != Opcode::Neg) return { Low, High };
+		Range a = range[q.src1], b = q.op == Opcode::Neg ? Range{ 0, 0 } : range[q.src2];
+		if (none(a) || none(b)) return { High, Low };
+		switch (q.op) {
+		case Opcode::Add: return fit(a.lo + b.lo, a.hi + b.hi);
+		case Opcode::Sub: return fit(a.lo - b.hi, a.hi - b.lo);
+		case Opcode::Neg: return fit(-a.hi, -a.lo);
+		default:
+			break;
+		}
+		if (q.op == Opcode::Div && b.lo <= 0 && b.hi >= 0) return { Low, High };
+		long long c[4];
+		for (int k = 0; k < 4; k++) {
+			long long x = k & 1 ? a.hi : a.lo, y = k & 2 ? b.hi : b.lo;
+			c[k] = q.op == Opcode::Mul ? x * y : x / y;
+		}
+		return fit(*std::min_element(c, c + 4), *std::max_element(c, c + 4));
+	}
+
+	// Ranges of the operands of the jump ending block p on its edge to s
+	void narrow(int p, int s, std::vector<std::pair<int, Range> >& out) const {
+		const Quad& q = code.quads[cfg.blocks[p].end - 1];
+		if ((q.op != Opcode::If && q.op != Opcode::IfFalse) || q.rel == Relop::None) return;
+		int taken = cfg.labels[q.label];
+		if (taken == p + 1 || !integral(q.src1) || !integral(q.src2)) return;
+		Relop rel = q.rel;
+		if ((q.op == Opcode::If) != (s == taken)) {
+			switch (rel) {
+			case Relop::Lt: rel = Relop::Ge; break;
+			case Relop::Le: rel = Relop::Gt; break;
+			case Relop::Gt: rel = Relop::Le; break;
+			case Relop::Ge: rel = Relop::Lt; break;
+			case Relop::Eq: rel = Relop::Ne; break;
+			default: rel = Relop::Eq; break;
+			}
+		}
+		Range a = range[q.src1], b = range[q.src2];
+		if (none(a) || none(b)) return;
+		switch (rel) {
+		case Relop::Lt: a.hi = std::min(a.hi, b.hi - 1); b.lo = std::max(b.lo, range[q.src1].lo + 1); break;
+		case Relop::Le: a.hi = std::min(a.hi, b.hi); b.lo = std::max(b.lo, range[q.src1].lo); break;
+		case Relop::Gt: a.lo = std::max(a.lo, b.lo + 1); b.hi = std::min(b.hi, range[q.src1].hi - 1); break;
+		case Relop::Ge: a.lo = std::max(a.lo, b.lo); b.hi = std::min(b.hi, range[q.src1].hi); break;
+		case Relop::Eq: a = b = meet(a, b); break;
+		default: return;
+		}
+		out.push_back({ q.src1, a });
+		out.push_back({ q.src2, b });
+	}
+
+	// Takes a new range for x, returns true if it changed. Ranges grow
+	// until they settle and then only narrow
+	bool update(int x, Range r, bool phi, bool narrowing) {
+		Range old = range[x], now = narrowing ? meet(old, r) : join(old, r);
+		if (now.lo == old.lo && now.hi == old.hi) return false;
+		if (!narrowing && phi && !none(old) && ++grown[x] > Widen) {
+			if (now.lo < old.lo) {
+				auto k = std::upper_bound(steps.begin(), steps.end(), now.lo);
+				now.lo = k == steps.begin() ? Low : std::max(*--k, Low);
+			}
+			if (now.hi > old.hi) {
+				auto k = std::lower_bound(steps.begin(), steps.end(), now.hi);
+				now.hi = k == steps.end() ? High : std::min(*k, High);
+			}
+		}
+		range[x] = now;
+		return true;
+	}
+
+	// Narrows the ranges to the edge from p to s, saving the ranges replaced
+	void enter(int p, int s, std::vector<std::pair<int, Range> >& saved) {
+		std::vector<std::pair<int, Range> > narrowed;
+		narrow(p, s, narrowed);
+		for (auto& n : narrowed) {
+			if (code.operands[n.first].kind == Operand::Const) continue;
+			saved.push_back({ n.first, range[n.first] });
+			range[n.first] = meet(range[n.first], n.second);
+		}
+	}
+
+	void restore(std::vector<std::pair<int, Range> >& saved) {
+		for (size_t k = saved.size(); k-- > 0;) range[saved[k].first] = saved[k].second;
+		saved.clear();
+	}
+
+	// Walks the dominator tree once, returns true if a range changed
+	bool walk(bool narrowing) {
+		struct Frame { int block; size_t child; std::vector<std::pair<int, Range> > saved; };
+		std::vector<Frame> stack = { { 0, 0, {} } };
+		std::vector<std::pair<int, Range> > edge;
+		bool changed = false, entering = true;
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			int b = f.block;
+			if (entering) {
+				// The edge from the only predecessor holds in the block
+				CFG::Edges preds = cfg.predecessors(b);
+				int p = -1, count = 0;
+				for (int q : preds) {
+					if (ssa.dom.reachable(q)) { p = q; count++; }
+				}
+				if (count == 1) enter(p, b, f.saved);
+
+				for (size_t k = 0; k < ssa.phis[b].size(); k++) {
+					const SSA::Phi& phi = ssa.phis[b][k];
+					Range r = { High, Low };
+					for (size_t j = 0; j < phi.args.size(); j++) {
+						if (j >= preds.size()) r = join(r, range[phi.args[j]]);
+						else if (ssa.dom.reachable(preds.begin()[j])) r = join(r, incoming[b][k][j]);
+					}
+					if (integral(phi.dest)) changed |= update(phi.dest, r, true, narrowing);
+				}
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					int d = code.quads[i].def();
+					if (d != Quad::None && integral(d)) changed |= update(d, eval(code.quads[i]), false, narrowing);
+				}
+
+				// The arguments the edges to the successors carry
+				for (int s : cfg.successors(b)) {
+					if (ssa.phis[s].empty()) continue;
+					enter(b, s, edge);
+					CFG::Edges into = cfg.predecessors(s);
+					for (size_t j = 0; j < into.size(); j++) {
+						if (into.begin()[j] != b) continue;
+						for (size_t k = 0; k < ssa.phis[s].size(); k++) incoming[s][k][j] = range[ssa.phis[s][k].args[j]];
+					}
+					restore(edge);
+				}
+			}
+			if (f.child < ssa.dom.children[b].size()) {
+				int c = ssa.dom.children[b][f.child++];
+				stack.push_back({ c, 0, {} });
+				entering = true;
+			}
+			else {
+				restore(f.saved);
+				stack.pop_back();
+				entering = false;
+			}
+		}
+		return changed;
+	}
+};
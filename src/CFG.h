@@ -0,0 +1,102 @@
+#pragma once
+#include "IR.h"
+#include <ostream>
+
+/*
+	Control-flow graph of the three-address code. A basic block starts at
+	a run of labels or after a jump, the edges are kept in compressed
+	sparse rows: the successors of block b are succs[succStart[b]] up to
+	succs[succStart[b + 1]], likewise for the predecessors
+*/
+class CFG {
+public:
+	// Instructions [begin, end) of the code
+	struct Block { int begin, end; };
+
+	// Iteration over the edges of one block
+	struct Edges {
+		const int* first;
+		const int* last;
+		const int* begin() const { return first; }
+		const int* end() const { return last; }
+		size_t size() const { return last - first; }
+	};
+
+	std::vector<Block> blocks;
+	std::vector<int> succStart, succs;
+	std::vector<int> predStart, preds;
+	std::vector<int> labels; // Block of each label number, or -1
+
+	CFG(const Code& code) { build(code); }
+
+	Edges successors(int b) const { return { succs.data() + succStart[b], succs.data() + succStart[b + 1] }; }
+	Edges predecessors(int b) const { return { preds.data() + predStart[b], preds.data() + predStart[b + 1] }; }
+
+	void build(const Code& code) {
+		const std::vector<Quad>& quads = code.quads;
+		blocks.clear(); labels.clear();
+
+		// Partition the instructions at leaders
+		int n = (int)quads.size();
+		for (int i = 0; i < n; i++) {
+			bool leader = i == 0 || quads[i - 1].jump()
+				|| (quads[i].op == Opcode::Label && quads[i - 1].op != Opcode::Label);
+			if (leader) {
+				if (!blocks.empty()) blocks.back().end = i;
+				blocks.push_back({ i, n });
+			}
+			if (quads[i].op == Opcode::Label) {
+				if (quads[i].label >= (int)labels.size()) labels.resize(quads[i].label + 1, -1);
+				labels[quads[i].label] = (int)blocks.size() - 1;
+			}
+		}
+
+		// Successors of each block, counted first to fill the rows in place
+		int count = (int)blocks.size();
+		std::vector<int> targets;
+		succStart.assign(count + 1, 0);
+		succs.clear();
+		for (int b = 0; b < count; b++) {
+			targets.clear();
+			const Quad& last = quads[blocks[b].end - 1];
+			if (last.jump()) targets.push_back(labels[last.label]);
+			if (last.op != Opcode::Goto && b + 1 < count && (targets.empty() || targets[0] != b + 1)) targets.push_back(b + 1);
+			succs.insert(succs.end(), targets.begin(), targets.end());
+			succStart[b + 1] = (int)succs.size();
+		}
+
+		// Predecessors by transposing the successor rows
+		predStart.assign(count + 1, 0);
+		for (int s : succs) predStart[s + 1]++;
+		for (int b = 0; b < count; b++) predStart[b + 1] += predStart[b];
+		preds.assign(succs.size(), 0);
+		std::vector<int> fill(predStart.begin(), predStart.end() - 1);
+		for (int b = 0; b < count; b++) {
+			for (int s : successors(b)) preds[fill[s]++] = b;
+		}
+	}
+
+	void toDot(std::ostream& os, const Code& code) const {
+		MemorySink line;
+		os << "digraph CFG {" << std::endl;
+		os << '\t' << "node[fontname = \"helvetica\", shape=box]" << std::endl;
+		for (int b = 0; b < (int)blocks.size(); b++) {
+			os << '\t' << b << " [label=\"B" << b << "\\l";
+			for (int i = blocks[b].begin; i < blocks[b].end; i++) {
+				line.clear();
+				code.format(code.quads[i], line);
+				// One instruction per line, the tab and line break are dropped
+				const char* s = line.data();
+				size_t n = line.size();
+				if (n > 0 && s[n - 1] == '\n') n--;
+				if (n > 0 && s[0] == '\t') { s++; n--; }
+				os.write(s, n) << "\\l";
+			}
+			os << "\"]" << std::endl;
+		}
+		for (int b = 0; b < (int)blocks.size(); b++) {
+			for (int s : successors(b)) os << '\t' << b << " -> " << s << std::endl;
+		}
+		os << "}" << std::endl;
+	}
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include "IR.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class Node;
+
+/*
+	Value table of the current basic block: maps a node of the
+	expression DAG to the temporary already holding its value
+*/
+class Values {
+public:
+	int find(Node* x) {
+		auto result = temps.find(x);
+		if (result != temps.end()) return result->second;
+		return Quad::None;
+	}
+
+	void put(Node* x, int t, const std::vector<Node*>& operands) {
+		temps[x] = t;
+		for (Node* o : operands) users[o].push_back(x);
+	}
+
+	// Forget every value computed from x, e.g. after x is assigned
+	void kill(Node* x) {
+		std::vector<Node*> work = { x };
+		while (!work.empty()) {
+			Node* n = work.back(); work.pop_back();
+			auto result = users.find(n);
+			if (result == users.end()) continue;
+			for (Node* u : result->second) {
+				if (temps.erase(u)) work.push_back(u);
+			}
+			users.erase(result);
+		}
+	}
+
+	// Values do not survive the start of a new basic block
+	void clear() { temps.clear(); users.clear(); }
+
+private:
+	std::unordered_map<Node*, int> temps;
+	std::unordered_map<Node*, std::vector<Node*> > users;
+};
+
+/*
+	State of one compilation for generating the three-address code.
+	Every compilation owns its context, so that several programs can be
+	compiled at the same time and numbering starts over for each one
+*/
+class Context {
+public:
+	Context() : labels(0), temps(0) {}
+
+	Code code; // Three-address code
+	int labels;
+	int temps;
+	Values values;
+
+	int newlabel() { return ++labels; }
+	int newtemp(std::shared_ptr<Type> p) { return code.temp(p, ++temps); }
+	void emitlabel(int i) {
+		values.clear();
+		Quad q(Opcode::Label);
+		q.label = i;
+		code.emit(q);
+	}
+	void emit(Quad q) { code.emit(q); }
+	void emitgoto(int i) {
+		Quad q(Opcode::Goto);
+		q.label = i;
+		code.emit(q);
+	}
+};
@@ -0,0 +1,216 @@
+#pragma once
+#include "SSA.h"
+
+/*
+	Copy propagation and coalescing on the SSA form. A copy from a
+	temporary read by nothing else is coalesced: the instruction assigning
+	the temporary assigns the destination of the copy instead. A phi
+	merging temporaries into such a copy is coalesced the same way, with
+	the instructions assigning its arguments, when the destination has no
+	phi of its own. The other copies are propagated, their destination is
+	replaced by their source in every read, unless the name of the source
+	is assigned again before one of the reads: both versions would then be
+	live at once and the copy come back when leaving the SSA form
+*/
+class Copies {
+public:
+	// Returns the number of copies removed
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		SSA ssa(code, analyses);
+		Copies pass(code, ssa);
+		int removed = pass.coalesce();
+		removed += pass.propagate();
+		ssa.leave(pass.removed);
+		return removed;
+	}
+
+private:
+	Code& code;
+	SSA& ssa;
+	const CFG& cfg;
+	std::vector<int> at; // Instruction assigning each name, or -1
+	std::vector<std::pair<int, int> > phiAt; // Phi assigning each name, as block and index
+	std::vector<int> uses; // Reads of each name by instructions and phis
+	std::vector<int> versions; // Highest version of each name
+	std::vector<char> merged; // Names with a phi
+	std::vector<char> removed;
+
+	Copies(Code& c, SSA& s) : code(c), ssa(s), cfg(s.cfg) {
+		std::vector<Quad>& quads = code.quads;
+		size_t n = code.operands.size();
+		at.assign(n, -1);
+		phiAt.assign(n, { -1, -1 });
+		uses.assign(n, 0);
+		versions.assign(n, 0);
+		merged.assign(n, 0);
+		removed.assign(quads.size(), 0);
+		int u[3];
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (quads[i].def() != Quad::None) at[quads[i].def()] = i;
+				int k = quads[i].uses(u);
+				for (int j = 0; j < k; j++) uses[u[j]]++;
+			}
+			for (size_t p = 0; p < ssa.phis[b].size(); p++) {
+				const SSA::Phi& phi = ssa.phis[b][p];
+				phiAt[phi.dest] = { b, (int)p };
+				merged[phi.origin] = 1;
+				for (int x : phi.args) uses[x]++;
+			}
+		}
+		for (const Operand& o : code.operands) {
+			if (o.version > 0) versions[o.origin] = std::max(versions[o.origin], o.version);
+		}
+	}
+
+	int origin(int x) const { return code.operands[x].version > 0 ? code.operands[x].origin : x; }
+
+	bool same(int x, int y) const { return code.operands[x].type == code.operands[y].type; }
+
+	// A temporary read once, by the copy, with the type of its destination
+	bool single(int t, int x) const {
+		return code.operands[t].kind == Operand::Temp && t != x && uses[t] == 1 && same(t, x);
+	}
+
+	// Copies whose source takes their destination as its own, in dominator
+	// order so that a chain of copies folds into its first assignment
+	int coalesce() {
+		std::vector<Quad>& quads = code.quads;
+		int count = 0;
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				const Quad& q = quads[i];
+				if (q.op != Opcode::Copy) continue;
+				int x = q.dest, t = q.src1;
+				if (!single(t, x)) continue;
+				if (at[t] >= 0) {
+					quads[at[t]].dest = x;
+					at[x] = at[t];
+				}
+				else if (phiAt[t].first >= 0 && !merged[origin(x)]) {
+					SSA::Phi& phi = ssa.phis[phiAt[t].first][phiAt[t].second];
+					int o = origin(x);
+					merged[o] = 1;
+					phi.dest = x;
+					phi.origin = o;
+					for (int& a : phi.args) {
+						int reads = 0;
+						for (int y : phi.args) reads += y == a;
+						if (code.operands[a].kind != Operand::Temp || at[a] < 0 || uses[a] != reads || !same(a, x)) continue;
+						int v = code.version(o, ++versions[o]), d = a;
+						at.resize(code.operands.size(), -1);
+						uses.resize(code.operands.size(), 0);
+						quads[at[d]].dest = v;
+						at[v] = at[d];
+						uses[v] = reads;
+						for (int& y : phi.args) {
+							if (y == d) y = v;
+						}
+					}
+				}
+				else continue;
+				removed[i] = 1;
+				count++;
+			}
+		}
+		return count;
+	}
+
+	// The other copies between names of one type, then every read of
+	// their destination reads the source. A copy whose source is replaced
+	// before a read of its destination is kept, until none is
+	int propagate() {
+		std::vector<Quad>& quads = code.quads;
+		std::vector<int> value;
+		std::vector<char> kept(quads.size(), 0);
+		int count;
+		do {
+			value.resize(code.operands.size());
+			for (size_t x = 0; x < value.size(); x++) value[x] = (int)x;
+			count = 0;
+			for (int b : ssa.dom.order) {
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					const Quad& q = quads[i];
+					if (q.op != Opcode::Copy || removed[i] || kept[i] || !same(q.dest, q.src1)) continue;
+					if (code.operands[q.dest].kind == Operand::Var && dynamic_cast<Array*>(code.operands[q.dest].type.get()) != nullptr) continue;
+					if (ssa.result(q.dest)) continue; // The variable keeps its value at the end
+					value[q.dest] = value[q.src1];
+					count++;
+				}
+			}
+		} while (count > 0 && keep(value, kept));
+		if (count == 0) return 0;
+
+		for (size_t i = 0; i < quads.size(); i++) {
+			if (quads[i].op == Opcode::Copy && quads[i].dest < (int)value.size() && value[quads[i].dest] != quads[i].dest) removed[i] = 1;
+		}
+		int* p[3];
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int k = quads[i].uses(p);
+				for (int j = 0; j < k; j++) {
+					if (*p[j] < (int)value.size()) *p[j] = value[*p[j]];
+				}
+			}
+			for (SSA::Phi& phi : ssa.phis[b]) {
+				for (int& x : phi.args) {
+					if (x < (int)value.size()) x = value[x];
+				}
+			}
+		}
+		return count;
+	}
+
+	// Walks the dominator tree with the current version of each name, and
+	// keeps the copies read where their source is no longer current.
+	// Returns true if one was kept
+	bool keep(const std::vector<int>& value, std::vector<char>& kept) {
+		std::vector<Quad>& quads = code.quads;
+		std::vector<std::vector<int> > stacks(code.operands.size());
+		bool changed = false;
+		auto read = [&](int x) {
+			if (x >= (int)value.size() || value[x] == x) return;
+			int y = value[x];
+			const std::vector<int>& s = stacks[origin(y)];
+			if (code.operands[y].kind == Operand::Const || (s.empty() ? origin(y) : s.back()) == y) return;
+			kept[at[x]] = 1;
+			changed = true;
+		};
+		struct Frame { int block; size_t child; std::vector<int> pushed; };
+		std::vector<Frame> stack = { { 0, 0, {} } };
+		auto define = [&](int x, Frame& f) {
+			stacks[origin(x)].push_back(x);
+			f.pushed.push_back(origin(x));
+		};
+		bool entering = true;
+		int u[3];
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			int b = f.block;
+			if (entering) {
+				for (const SSA::Phi& phi : ssa.phis[b]) define(phi.dest, f);
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					int k = quads[i].uses(u);
+					for (int j = 0; j < k; j++) read(u[j]);
+					if (quads[i].def() != Quad::None) define(quads[i].def(), f);
+				}
+				for (int s : cfg.successors(b)) {
+					int j = ssa.edge(s, b);
+					for (const SSA::Phi& phi : ssa.phis[s]) read(phi.args[j]);
+				}
+			}
+			if (f.child < ssa.dom.children[b].size()) {
+				int c = ssa.dom.children[b][f.child++];
+				stack.push_back({ c, 0, {} });
+				entering = true;
+			}
+			else {
+				for (int x : f.pushed) stacks[x].pop_back();
+				stack.pop_back();
+				entering = false;
+			}
+		}
+		return changed;
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include "SSA.h"
+
+/*
+	Dead code elimination. The blocks the entry does not reach are
+	removed, then on the SSA form the instructions with an effect, the
+	stores into arrays and the jumps, and the assignments of the values
+	the variables hold at the end of the code are marked, and the marks
+	follow the operands back to their assignments. The assignments left
+	unmarked, to variables overwritten before they are read included,
+	are swept
+*/
+class Dead {
+public:
+	// Returns the number of instructions removed from unreachable blocks
+	static int unreachable(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		const CFG& cfg = analyses.cfg();
+		std::vector<char> seen(cfg.blocks.size(), 0);
+		std::vector<int> work = { 0 };
+		seen[0] = 1;
+		while (!work.empty()) {
+			int b = work.back(); work.pop_back();
+			for (int s : cfg.successors(b)) {
+				if (!seen[s]) { seen[s] = 1; work.push_back(s); }
+			}
+		}
+
+		std::vector<Quad>& quads = code.quads;
+		int j = 0, removed = 0;
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (seen[b]) quads[j++] = quads[i];
+				else if (quads[i].op != Opcode::Label) removed++;
+			}
+		}
+		if (j == (int)quads.size()) return 0;
+		quads.erase(quads.begin() + j, quads.end());
+		analyses.invalidate(Analyses::Graph);
+		return removed;
+	}
+
+	// Returns the number of assignments removed
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		SSA ssa(code, analyses);
+		const CFG& cfg = ssa.cfg;
+		std::vector<Quad>& quads = code.quads;
+		size_t n = code.operands.size();
+
+		// Assignment of each name, an instruction or a phi as block and index
+		std::vector<int> at(n, -1);
+		std::vector<std::pair<int, int> > phiAt(n, { -1, -1 });
+		std::vector<std::vector<char> > phiMarked(cfg.blocks.size());
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			if (!ssa.dom.reachable(b)) continue;
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (quads[i].def() != Quad::None) at[quads[i].def()] = i;
+			}
+			phiMarked[b].assign(ssa.phis[b].size(), 0);
+			for (size_t p = 0; p < ssa.phis[b].size(); p++) phiAt[ssa.phis[b][p].dest] = { b, (int)p };
+		}
+
+		std::vector<char> marked(quads.size(), 0);
+		std::vector<int> work;
+		auto need = [&](int x) {
+			if (at[x] >= 0 && !marked[at[x]]) {
+				marked[at[x]] = 1;
+				work.push_back(at[x]);
+			}
+			else if (phiAt[x].first >= 0 && !phiMarked[phiAt[x].first][phiAt[x].second]) {
+				phiMarked[phiAt[x].first][phiAt[x].second] = 1;
+				for (int y : ssa.phis[phiAt[x].first][phiAt[x].second].args) work.push_back(~y);
+			}
+		};
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			if (!ssa.dom.reachable(b)) continue;
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				Opcode op = quads[i].op;
+				if (op == Opcode::Store || op == Opcode::VStore || op == Opcode::Check || op == Opcode::Label || quads[i].jump()) {
+					marked[i] = 1;
+					work.push_back(i);
+				}
+			}
+		}
+
+		// The variables hold the results of the program at its end
+		for (int v : ssa.exit) {
+			if (ssa.result(v)) need(v);
+		}
+
+		// An instruction is pushed as its index, a phi argument as ~operand
+		int u[3];
+		while (!work.empty()) {
+			int w = work.back(); work.pop_back();
+			if (w < 0) { need(~w); continue; }
+			int k = quads[w].uses(u);
+			for (int j = 0; j < k; j++) need(u[j]);
+		}
+
+		std::vector<char> removed(quads.size(), 0);
+		int count = 0;
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			if (!ssa.dom.reachable(b)) continue;
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (!marked[i]) { removed[i] = 1; count++; }
+			}
+			auto& phis = ssa.phis[b];
+			size_t k = 0;
+			for (size_t p = 0; p < phis.size(); p++) {
+				if (phiMarked[b][p]) phis[k++] = phis[p];
+			}
+			phis.resize(k);
+		}
+		ssa.leave(removed);
+		return count;
+	}
+};
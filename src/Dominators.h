@@ -0,0 +1,140 @@
+#pragma once
+#include "CFG.h"
+
+/*
+	Dominator tree and dominance frontiers of a control-flow graph, with
+	the semi-NCA algorithm: the semidominators are found as in Lengauer
+	and Tarjan, walking the search tree with path compression, and the
+	immediate dominator of a block is the nearest common ancestor of its
+	semidominator and its parent. Nearly linear, even for a block joined
+	from many others as a long && makes. The entry is block 0, blocks it
+	does not reach have no immediate dominator
+*/
+class Dominators {
+public:
+	std::vector<int> order; // Reachable blocks in reverse postorder
+	std::vector<int> idom; // Immediate dominator, the entry is its own, -1 if unreachable
+	std::vector<std::vector<int> > children; // Dominator tree
+	std::vector<std::vector<int> > frontier;
+
+	Dominators(const CFG& cfg) {
+		int count = (int)cfg.blocks.size();
+		idom.assign(count, -1);
+		children.assign(count, {});
+		frontier.assign(count, {});
+		if (count == 0) return;
+		std::vector<int> pre(count, -1), vertex, parent;
+		search(cfg, pre, vertex, parent);
+		int n = (int)vertex.size();
+
+		// Semidominators by preorder number, from the last block. The
+		// ancestors of the blocks processed are compressed to the one whose
+		// semidominator is least on the way up
+		std::vector<int> semi(n), label(n), ancestor = parent, path;
+		for (int i = 0; i < n; i++) semi[i] = label[i] = i;
+		auto eval = [&](int v, int linked) {
+			if (ancestor[v] < linked) return label[v];
+			int x = v;
+			do { path.push_back(x); x = ancestor[x]; } while (ancestor[x] >= linked);
+			int p = x, least = label[x];
+			while (!path.empty()) {
+				int y = path.back(); path.pop_back();
+				ancestor[y] = ancestor[p];
+				if (semi[least] < semi[label[y]]) label[y] = least;
+				else least = label[y];
+				p = y;
+			}
+			return label[v];
+		};
+		for (int i = n - 1; i > 0; i--) {
+			semi[i] = parent[i];
+			for (int p : cfg.predecessors(vertex[i])) {
+				if (pre[p] >= 0) semi[i] = std::min(semi[i], semi[eval(pre[p], i + 1)]);
+			}
+		}
+
+		// The immediate dominator is the first ancestor of the parent not
+		// below the semidominator
+		std::vector<int> dom(n, 0);
+		for (int i = 1; i < n; i++) {
+			int d = parent[i];
+			while (d > semi[i]) d = dom[d];
+			dom[i] = d;
+		}
+		for (int i = 0; i < n; i++) idom[vertex[i]] = vertex[dom[i]];
+		for (int b : order) {
+			if (b != 0) children[idom[b]].push_back(b);
+		}
+
+		// A join point is in the frontier of the blocks from each of its
+		// predecessors up to, not including, its immediate dominator. The
+		// entry is also entered from outside, so it is a join point as soon
+		// as it has a predecessor and the walk goes up to the root included
+		for (int b : order) {
+			if (cfg.predecessors(b).size() < (b == 0 ? 1u : 2u)) continue;
+			for (int p : cfg.predecessors(b)) {
+				for (int r = p; idom[r] >= 0 && (b == 0 || r != idom[b]); r = idom[r]) {
+					if (!frontier[r].empty() && frontier[r].back() == b) break;
+					frontier[r].push_back(b);
+					if (r == 0) break;
+				}
+			}
+		}
+
+		// Preorder and postorder numbers of the tree answer dominates()
+		enter.assign(count, -1); leave.assign(count, -1);
+		int clock = 0;
+		std::vector<std::pair<int, size_t> > stack = { { 0, 0 } };
+		enter[0] = clock++;
+		while (!stack.empty()) {
+			auto& top = stack.back();
+			if (top.second < children[top.first].size()) {
+				int c = children[top.first][top.second++];
+				enter[c] = clock++;
+				stack.push_back({ c, 0 });
+			}
+			else {
+				leave[top.first] = clock++;
+				stack.pop_back();
+			}
+		}
+	}
+
+	bool reachable(int b) const { return idom[b] >= 0; }
+
+	// True if every path from the entry to b goes through a
+	bool dominates(int a, int b) const {
+		return reachable(a) && reachable(b) && enter[a] <= enter[b] && leave[b] <= leave[a];
+	}
+
+private:
+	std::vector<int> enter, leave;
+
+	// Depth-first search from the entry: the preorder number of each block,
+	// the blocks by that number with their parents in the search tree by
+	// number, and the reverse postorder
+	void search(const CFG& cfg, std::vector<int>& pre, std::vector<int>& vertex, std::vector<int>& parent) {
+		std::vector<std::pair<int, size_t> > stack = { { 0, 0 } };
+		pre[0] = 0;
+		vertex.push_back(0);
+		parent.push_back(-1);
+		while (!stack.empty()) {
+			auto& top = stack.back();
+			CFG::Edges succs = cfg.successors(top.first);
+			if (top.second < succs.size()) {
+				int s = succs.begin()[top.second++];
+				if (pre[s] < 0) {
+					pre[s] = (int)vertex.size();
+					vertex.push_back(s);
+					parent.push_back(pre[top.first]);
+					stack.push_back({ s, 0 });
+				}
+			}
+			else {
+				order.push_back(top.first);
+				stack.pop_back();
+			}
+		}
+		std::reverse(order.begin(), order.end());
+	}
+};
@@ -0,0 +1,307 @@
+#pragma once
+#include "Symbols.h"
+#include "Sink.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+	Operation codes of three-address instructions
+*/
+enum class Opcode : uint8_t {
+	Label,		// L:
+	Copy,		// dest = src1
+	Add,		// dest = src1 + src2
+	Sub,		// dest = src1 - src2
+	Mul,		// dest = src1 * src2
+	Div,		// dest = src1 / src2
+	Neg,		// dest = minus src1
+	Load,		// dest = src1 [ src2 ]
+	Store,		// dest [ src1 ] = src2
+	Goto,		// goto L
+	If,			// if src1 rel src2 goto L, or if src1 goto L
+	IfFalse,	// iffalse src1 rel src2 goto L, or iffalse src1 goto L
+	VLoad,		// dest = src1 [ src2 : w ], the w lanes of vector dest
+	VStore,		// dest [ src1 : w ] = src2, the w lanes of vector src2
+	VAdd,		// dest = src1 + src2 lane by lane, a scalar is in every lane
+	VSub,		// dest = src1 - src2 lane by lane
+	VMul,		// dest = src1 * src2 lane by lane
+	VSplat,		// dest = splat src1, src1 in every lane
+	Check		// check src1 [ src2 ], stops unless src2 is the offset of an element
+};
+
+/*
+	Relational operator of a conditional jump
+*/
+enum class Relop : uint8_t { None, Lt, Le, Gt, Ge, Eq, Ne };
+
+/*
+	Three-address instruction, the operands are indices into the operand
+	table of the code and the label is the number of the label
+*/
+struct Quad {
+	static constexpr int None = -1;
+
+	Opcode op;
+	Relop rel;
+	int dest, src1, src2;
+	int label;
+
+	Quad(Opcode o, int d = None, int s1 = None, int s2 = None) : op(o), rel(Relop::None), dest(d), src1(s1), src2(s2), label(0) {}
+
+	bool jump() const { return op == Opcode::Goto || op == Opcode::If || op == Opcode::IfFalse; }
+
+	// Operand assigned by the instruction, or None. A store changes one
+	// element and is not an assignment of the array
+	int def() const {
+		switch (op) {
+		case Opcode::Copy: case Opcode::Add: case Opcode::Sub: case Opcode::Mul:
+		case Opcode::Div: case Opcode::Neg: case Opcode::Load:
+		case Opcode::VLoad: case Opcode::VAdd: case Opcode::VSub: case Opcode::VMul: case Opcode::VSplat:
+			return dest;
+		default:
+			return None;
+		}
+	}
+
+	// Fields of the operands read by the instruction, returns their number
+	int uses(int* u[3]) {
+		switch (op) {
+		case Opcode::Copy: case Opcode::Neg: case Opcode::VSplat:
+			u[0] = &src1;
+			return 1;
+		case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div: case Opcode::Load:
+		case Opcode::VLoad: case Opcode::VAdd: case Opcode::VSub: case Opcode::VMul: case Opcode::Check:
+			u[0] = &src1; u[1] = &src2;
+			return 2;
+		case Opcode::Store: case Opcode::VStore:
+			u[0] = &dest; u[1] = &src1; u[2] = &src2;
+			return 3;
+		case Opcode::If: case Opcode::IfFalse:
+			u[0] = &src1; u[1] = &src2;
+			return rel == Relop::None ? 1 : 2;
+		default:
+			return 0;
+		}
+	}
+
+	int uses(int u[3]) const {
+		int* p[3];
+		int n = const_cast<Quad*>(this)->uses(p);
+		for (int i = 0; i < n; i++) u[i] = *p[i];
+		return n;
+	}
+};
+
+/*
+	Operand of three-address instructions
+*/
+struct Operand {
+	enum Kind : uint8_t { Var, Temp, Const };
+
+	Kind kind;
+	std::shared_ptr<Type> type; // Gives the width of the operand
+	std::string name; // Name of a variable or lexeme of a constant
+	int number; // Number of a temporary
+	int version = 0; // Number of an SSA version, 0 for the operand itself
+	int origin = -1; // Operand of which this is a version
+};
+
+/*
+	Three-address code of a program in quadruples
+*/
+class Code {
+public:
+	std::vector<Quad> quads;
+	std::vector<Operand> operands;
+
+	// Operand already made for a node of the AST, or None
+	int find(const void* node) {
+		auto result = nodes.find(node);
+		if (result != nodes.end()) return result->second;
+		return Quad::None;
+	}
+
+	// Operand of a variable, identified by its declaration
+	int var(const void* decl, std::string name, std::shared_ptr<Type> p) {
+		int i = find(decl);
+		if (i != Quad::None) return i;
+		i = add({ Operand::Var, p, name, 0 });
+		nodes.emplace(decl, i);
+		return i;
+	}
+
+	// Operand of a constant, shared by the nodes with the same lexeme
+	int constant(const void* node, std::string lexeme, std::shared_ptr<Type> p) {
+		int i = find(node);
+		if (i != Quad::None) return i;
+		i = constant(lexeme, p);
+		nodes.emplace(node, i);
+		return i;
+	}
+
+	int constant(std::string lexeme, std::shared_ptr<Type> p) {
+		auto key = std::make_pair(lexeme, p.get());
+		auto result = constants.find(key);
+		if (result != constants.end()) return result->second;
+		int i = add({ Operand::Const, p, lexeme, 0 });
+		constants.emplace(key, i);
+		return i;
+	}
+
+	// New SSA version of operand x
+	int version(int x, int number) {
+		Operand o = operands[x];
+		o.version = number;
+		o.origin = x;
+		return add(o);
+	}
+
+	// Operand of an integer constant made by an optimization
+	int constant(int value) { return constant(std::to_string(value), Type::Int); }
+
+	// Value of an integer constant operand
+	bool integer(int i, int& value) const {
+		if (i == Quad::None || operands[i].kind != Operand::Const || operands[i].type != Type::Int) return false;
+		value = std::stoi(operands[i].name);
+		return true;
+	}
+
+	int temp(std::shared_ptr<Type> p, int number) {
+		return add({ Operand::Temp, p, "", number });
+	}
+
+	// Width of the elements of an array
+	static int element(const Type& t) {
+		const Array* a = dynamic_cast<const Array*>(&t);
+		return a != nullptr ? element(*a->of) : t.width;
+	}
+
+	// Lanes of a vector temporary, an array of its lanes, 0 for a scalar
+	int lanes(int x) const {
+		const Operand& o = operands[x];
+		Array* a = o.kind == Operand::Temp ? dynamic_cast<Array*>(o.type.get()) : nullptr;
+		return a != nullptr ? a->size : 0;
+	}
+
+	void emit(Quad q) { quads.push_back(q); }
+
+	void print(Sink& out) const {
+		for (const Quad& q : quads) format(q, out);
+	}
+
+	// Appends the text of an instruction, a label is followed by the
+	// instruction on the same line
+	void format(const Quad& q, Sink& out) const {
+		if (q.op == Opcode::Label) {
+			out.put('L'); out.number(q.label); out.put(':');
+			return;
+		}
+		out.put('\t');
+		switch (q.op) {
+		case Opcode::Copy:
+			operand(q.dest, out); out.write(" = "); operand(q.src1, out);
+			break;
+		case Opcode::Add:
+		case Opcode::Sub:
+		case Opcode::Mul:
+		case Opcode::Div:
+		case Opcode::VAdd:
+		case Opcode::VSub:
+		case Opcode::VMul:
+			operand(q.dest, out); out.write(" = "); operand(q.src1, out);
+			out.put(' '); out.write(symbol(q.op)); out.put(' ');
+			operand(q.src2, out);
+			break;
+		case Opcode::Neg:
+			operand(q.dest, out); out.write(" = minus "); operand(q.src1, out);
+			break;
+		case Opcode::Load:
+			operand(q.dest, out); out.write(" = "); operand(q.src1, out);
+			out.write(" [ "); operand(q.src2, out); out.write(" ]");
+			break;
+		case Opcode::Store:
+			operand(q.dest, out); out.write(" [ "); operand(q.src1, out);
+			out.write(" ] = "); operand(q.src2, out);
+			break;
+		case Opcode::VLoad:
+			operand(q.dest, out); out.write(" = "); operand(q.src1, out);
+			out.write(" [ "); operand(q.src2, out); out.write(" : "); out.number(lanes(q.dest)); out.write(" ]");
+			break;
+		case Opcode::VStore:
+			operand(q.dest, out); out.write(" [ "); operand(q.src1, out);
+			out.write(" : "); out.number(lanes(q.src2)); out.write(" ] = "); operand(q.src2, out);
+			break;
+		case Opcode::VSplat:
+			operand(q.dest, out); out.write(" = splat "); operand(q.src1, out);
+			break;
+		case Opcode::Check:
+			out.write("check "); operand(q.src1, out);
+			out.write(" [ "); operand(q.src2, out); out.write(" ]");
+			break;
+		case Opcode::Goto:
+			out.write("goto L"); out.number(q.label);
+			break;
+		case Opcode::If:
+		case Opcode::IfFalse:
+			out.write(q.op == Opcode::If ? "if " : "iffalse ");
+			operand(q.src1, out);
+			if (q.rel != Relop::None) {
+				out.put(' '); out.write(symbol(q.rel)); out.put(' ');
+				operand(q.src2, out);
+			}
+			out.write(" goto L"); out.number(q.label);
+			break;
+		default:
+			break;
+		}
+		out.put('\n');
+	}
+
+	void operand(int i, Sink& out) const {
+		const Operand& o = operands[i];
+		if (o.kind == Operand::Temp) { out.put(lanes(i) > 0 ? 'v' : 't'); out.number(o.number); }
+		else out.write(o.name);
+		if (o.version > 0) { out.put('.'); out.number(o.version); }
+	}
+
+	std::string name(int i) const {
+		const Operand& o = operands[i];
+		std::string s = o.kind == Operand::Temp ? (lanes(i) > 0 ? "v" : "t") + std::to_string(o.number) : o.name;
+		if (o.version > 0) s += "." + std::to_string(o.version);
+		return s;
+	}
+
+	static const char* symbol(Opcode op) {
+		switch (op) {
+		case Opcode::Add: case Opcode::VAdd: return "+";
+		case Opcode::Sub: case Opcode::VSub: return "-";
+		case Opcode::Mul: case Opcode::VMul: return "*";
+		case Opcode::Div: return "/";
+		default: return "?";
+		}
+	}
+
+	static const char* symbol(Relop r) {
+		switch (r) {
+		case Relop::Lt: return "<";
+		case Relop::Le: return "<=";
+		case Relop::Gt: return ">";
+		case Relop::Ge: return ">=";
+		case Relop::Eq: return "==";
+		case Relop::Ne: return "!=";
+		default: return "";
+		}
+	}
+
+private:
+	std::map<const void*, int> nodes; // Operands of variables and constants
+	std::map<std::pair<std::string, Type*>, int> constants;
+
+	int add(Operand o) {
+		operands.push_back(o);
+		return (int)operands.size() - 1;
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+#include "Analyses.h"
+#include "Numbering.h"
+
+/*
+	Strength reduction of induction variables on the SSA form. A basic
+	induction variable is a phi of a loop header stepped by a constant on
+	every back edge, i = i + c. Its product by a constant width, the
+	offset of an array element, becomes a new variable started at the
+	product on entry and stepped by c * width beside the step of i. The
+	tests of i against a constant move to the new variable, and i goes
+	when nothing else reads it
+*/
+class Induction {
+public:
+	// Returns the number of multiplications replaced
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		SSA ssa(code, analyses);
+		Induction pass(code, ssa, analyses.loops());
+		int reduced = 0;
+		for (int l = 0; l < (int)pass.nest.loops.size(); l++) {
+			int h = pass.nest.loops[l].header;
+			for (size_t p = 0, count = ssa.phis[h].size(); p < count; p++) reduced += pass.reduce(l, h, (int)p);
+		}
+		pass.sweep();
+		return reduced;
+	}
+
+private:
+	// New variable of a width, its value at the header and once stepped
+	struct Derived { int width, at, stepped; };
+
+	// Phi of a basic variable, as block and index, and its stepped value
+	struct Counter { int block, phi, stepped; };
+
+	Code& code;
+	SSA& ssa;
+	const CFG& cfg;
+	Loops nest;
+	std::vector<int> at; // Instruction assigning each name, or -1
+	std::vector<int> uses; // Reads of each name by instructions and phis
+	std::vector<char> removed;
+	std::vector<std::vector<Quad> > after; // New instructions following each one
+	std::vector<Counter> counters;
+	int number = 0;
+
+	Induction(Code& c, SSA& s, const Loops& l) : code(c), ssa(s), cfg(s.cfg), nest(l) {
+		std::vector<Quad>& quads = code.quads;
+		at.assign(code.operands.size(), -1);
+		uses.assign(code.operands.size(), 0);
+		removed.assign(quads.size(), 0);
+		after.resize(quads.size());
+		int u[3];
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (quads[i].def() != Quad::None) at[quads[i].def()] = i;
+			}
+		}
+		for (const Quad& q : quads) {
+			int k = q.uses(u);
+			for (int j = 0; j < k; j++) uses[u[j]]++;
+		}
+		for (auto& phis : ssa.phis) {
+			for (auto& phi : phis) {
+				for (int x : phi.args) uses[x]++;
+			}
+		}
+		for (const Operand& o : code.operands) {
+			if (o.kind == Operand::Temp) number = std::max(number, o.number);
+		}
+	}
+
+	int version(int origin, int n) {
+		int x = code.version(origin, n);
+		at.resize(code.operands.size(), -1);
+		uses.resize(code.operands.size(), 0);
+		return x;
+	}
+
+	void replace(int& operand, int x) {
+		uses.resize(code.operands.size(), 0);
+		uses[operand]--;
+		uses[x]++;
+		operand = x;
+	}
+
+	// Reduces the products by phi p of header h if it is a basic induction
+	// variable of loop l, returns the number replaced
+	int reduce(int l, int h, int p) {
+		std::vector<Quad>& quads = code.quads;
+		const SSA::Phi phi = ssa.phis[h][p];
+		int i0 = phi.dest;
+		if (code.operands[i0].type != Type::Int) return 0;
+
+		// One value on entry and one stepped value on the back edges, the
+		// edges from blocks not reached are left out
+		CFG::Edges preds = cfg.predecessors(h);
+		int entry = Quad::None, next = Quad::None;
+		for (size_t j = 0; j < phi.args.size(); j++) {
+			if (j < preds.size() && !ssa.dom.reachable(preds.begin()[j])) continue;
+			int& v = j < preds.size() && nest.contains(l, preds.begin()[j]) ? next : entry;
+			if (v != Quad::None && v != phi.args[j]) return 0;
+			v = phi.args[j];
+		}
+		if (entry == Quad::None || next == Quad::None || at[next] < 0) return 0;
+		const Quad& s = quads[at[next]];
+		int step, start = 0;
+		bool sub = s.op == Opcode::Sub && s.src1 == i0 && code.integer(s.src2, step) && Numbering::fold(Opcode::Neg, step, 0, step);
+		if (!sub && !(s.op == Opcode::Add && s.src1 == i0 && code.integer(s.src2, step))
+			&& !(s.op == Opcode::Add && s.src2 == i0 && code.integer(s.src1, step))) return 0;
+		bool constant = code.integer(entry, start);
+		if (!constant && at[entry] < 0) return 0;
+		counters.push_back({ h, p, next });
+
+		std::vector<Derived> derived;
+		auto variable = [&](int w) {
+			for (size_t d = 0; d < derived.size(); d++) {
+				if (derived[d].width == w) return (int)d;
+			}
+			int first = 0, increment;
+			if ((constant && !Numbering::fold(Opcode::Mul, start, w, first)) || !Numbering::fold(Opcode::Mul, step, w, increment)) return -1;
+			int origin = code.temp(Type::Int, ++number);
+			int v = version(origin, 1), stepped = version(origin, 2), init;
+			if (constant) init = code.constant(first);
+			else {
+				init = version(origin, 3);
+				after[at[entry]].push_back(Quad(Opcode::Mul, init, entry, code.constant(w)));
+				uses[entry]++;
+			}
+			after[at[next]].push_back(Quad(Opcode::Add, stepped, v, code.constant(increment)));
+			uses.resize(code.operands.size(), 0);
+			uses[v]++;
+			SSA::Phi merge = { v, origin, {} };
+			for (size_t j = 0; j < phi.args.size(); j++) {
+				bool back = j < preds.size() && nest.contains(l, preds.begin()[j]);
+				merge.args.push_back(back ? stepped : init);
+				uses[merge.args.back()]++;
+			}
+			ssa.phis[h].push_back(merge);
+			derived.push_back({ w, v, stepped });
+			return (int)derived.size() - 1;
+		};
+
+		// Products of i or of its stepped value by a constant width
+		int reduced = 0;
+		for (int b : nest.loops[l].blocks) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				Quad& q = quads[i];
+				int w, x = q.src1 == i0 || q.src1 == next ? q.src1 : q.src2;
+				if (q.op != Opcode::Mul || (x != i0 && x != next) || code.operands[q.dest].type != Type::Int) continue;
+				if (!code.integer(x == q.src1 ? q.src2 : q.src1, w)) continue;
+				int d = variable(w);
+				if (d < 0) continue;
+				uses[q.src1]--;
+				uses[q.src2]--;
+				q = Quad(Opcode::Copy, q.dest, x == i0 ? derived[d].at : derived[d].stepped);
+				uses[q.src1]++;
+				reduced++;
+			}
+		}
+
+		// A test against a constant holds for the products by a positive
+		// width as it does for i
+		const Derived* by = nullptr;
+		for (const Derived& d : derived) {
+			if (d.width > 0) { by = &d; break; }
+		}
+		if (by == nullptr) return reduced;
+		for (int b : nest.loops[l].blocks) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				Quad& q = quads[i];
+				if ((q.op != Opcode::If && q.op != Opcode::IfFalse) || q.rel == Relop::None) continue;
+				int* v = q.src1 == i0 || q.src1 == next ? &q.src1 : q.src2 == i0 || q.src2 == next ? &q.src2 : nullptr;
+				int* c = v == &q.src1 ? &q.src2 : &q.src1;
+				int bound, scaled;
+				if (v == nullptr || !code.integer(*c, bound) || !Numbering::fold(Opcode::Mul, bound, by->width, scaled)) continue;
+				replace(*v, *v == i0 ? by->at : by->stepped);
+				replace(*c, code.constant(scaled));
+			}
+		}
+		return reduced;
+	}
+
+	// Removes the basic variables read by nothing but their own step, then
+	// leaves the SSA form
+	void sweep() {
+		std::vector<std::vector<char> > gone(cfg.blocks.size());
+		for (const Counter& c : counters) {
+			const SSA::Phi& phi = ssa.phis[c.block][c.phi];
+			int back = 0;
+			for (int x : phi.args) back += x == c.stepped;
+			if (uses[phi.dest] != 1 || uses[c.stepped] != back || ssa.result(phi.dest) || ssa.result(c.stepped)) continue;
+			removed[at[c.stepped]] = 1;
+			gone[c.block].resize(ssa.phis[c.block].size(), 0);
+			gone[c.block][c.phi] = 1;
+		}
+		for (size_t b = 0; b < gone.size(); b++) {
+			if (gone[b].empty()) continue;
+			auto& phis = ssa.phis[b];
+			size_t k = 0;
+			for (size_t p = 0; p < phis.size(); p++) {
+				if (!gone[b][p]) phis[k++] = phis[p];
+			}
+			phis.resize(k);
+		}
+		ssa.leave(removed, {}, after);
+	}
+};
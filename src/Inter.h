@@ -1,7 +1,10 @@
 #pragma once
 #include "Lexer.h"
 #include "Symbols.h"
+#include "Context.h"
 #include <iostream>
+#include <vector>
+#include <unordered_map>
 #include "nlohmann/json.hpp"
 using json = nlohmann::json;
 
@@ -10,34 +13,98 @@ using json = nlohmann::json;
 */
 class Node {
 public:
-	Node() : lexline(Lexer::line) {}
+	Node() : lexline(0) {}
 
 	int lexline;
 	void error(std::string s) {
 		throw std::runtime_error(s);
 	}
 
-	virtual json toJson() {
+	virtual ~Node() = default;
+
+	// Children of the node in the AST, operands of the node in the expression DAG
+	virtual std::vector<Node*> children() { return {}; }
+
+	// Attributes of the node in json, the children are added by toJson()
+	virtual json toJsonNode() {
 		return json({ {"name", "Node" } });
 	}
 
-	virtual uint32_t toDot(std::stringstream &ss) {
+	// Writes the node itself in dot and returns its id, the edges are added by toDot()
+	virtual uint32_t toDotNode(std::stringstream &ss) {
 		uint32_t id = hash(this);
 		ss << '\t' << id << ' ' << "[shape=box, label=\"Node\"]" << std::endl;
 		return id;
 	}
 
-	// For generating intermediate three-address code?
-	static int labels;
-	static std::hash<Node*> hash;
+	// Writes the subtree in json, with an explicit stack so that deep
+	// expressions do not overflow the call stack
+	void toJson(std::ostream& os) {
+		struct Frame { Node* n; std::vector<Node*> c; size_t i; std::string attrs; };
+		std::vector<Frame> stack;
+		auto enter = [&](Node* n) {
+			std::vector<Node*> c = n->children();
+			std::string attrs = n->toJsonNode().dump();
+			if (c.empty()) { os << attrs; return; }
+			// "children" goes first as keys are sorted like in json::dump()
+			os << "{\"children\":[";
+			stack.push_back({ n, std::move(c), 0, std::move(attrs) });
+		};
+		enter(this);
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			if (f.i < f.c.size()) {
+				Node* c = f.c[f.i];
+				if (f.i++ > 0) os << ',';
+				enter(c);
+			}
+			else {
+				os << "]," << f.attrs.substr(1);
+				stack.pop_back();
+			}
+		}
+	}
+
+	// Writes the subtree in dot and returns the id of its root
+	uint32_t toDot(std::stringstream& ss) {
+		struct Frame { Node* n; std::vector<Node*> c; size_t i; uint32_t id; };
+		std::vector<Frame> stack;
+		stack.push_back({ this, children(), 0, toDotNode(ss) });
+		for (;;) {
+			Frame& f = stack.back();
+			if (f.i < f.c.size()) {
+				Node* c = f.c[f.i++];
+				uint32_t id = c->toDotNode(ss);
+				stack.push_back({ c, c->children(), 0, id });
+				continue;
+			}
+			uint32_t id = f.id;
+			stack.pop_back();
+			if (stack.empty()) return id;
+			ss << '\t' << stack.back().id << " -> " << id << std::endl;
+		}
+	}
+
+	static const std::hash<Node*> hash;
 
-	int newlabel() { return ++labels; }
-	void emitlabel(int i) { std::cout << "L" << i << ":"; }
-	void emit(std::string s) { std::cout << "\t" << s << std::endl; }
+protected:
+	// Moves out the children owned by the node
+	virtual void detach(std::vector<std::shared_ptr<Node> >& nodes) {}
+
+	// Destroys the children of a node being destroyed one by one, instead
+	// of through a chain of nested destructors as deep as the tree
+	void release() {
+		std::vector<std::shared_ptr<Node> > nodes;
+		detach(nodes);
+		while (!nodes.empty()) {
+			std::shared_ptr<Node> n = std::move(nodes.back());
+			nodes.pop_back();
+			if (n.use_count() == 1) n->detach(nodes);
+		}
+	}
 };
 
-int Node::labels = 0;
-std::hash<Node*> Node::hash = std::hash<Node*>();
+const std::hash<Node*> Node::hash = std::hash<Node*>();
 
 /*
 	Node for expressions
@@ -49,64 +116,81 @@ public:
 	std::shared_ptr<Token> op;
 	std::shared_ptr<Type> type;
 
-	virtual std::shared_ptr<Expr> gen() { return shared_from_this();  }
-	virtual std::shared_ptr<Expr> reduce() { return shared_from_this(); }
-	virtual void jumping(int t, int f) {
-		emitjumps(toString(), t, f);
-	}
-	virtual void emitjumps(std::string test, int t, int f) {
-		std::stringstream ss;
-
-		if (t != 0 && f != 0) {
-			ss << "if " << test << " goto L" << t;
-			emit(ss.str());
-			ss.clear();
-			ss << "goto L" << f;
-			emit(ss.str());
-		}
-		else if (t != 0) {
-			ss << "if " << test << " goto L" << t;
-			emit(ss.str());
+	// Returns a three-address instruction without destination computing
+	// the expression, after generating the instructions for its operands
+	virtual Quad gen(Context& ctx) { return Quad(Opcode::Copy, Quad::None, reduce(ctx)); }
+	// Returns the operand holding the value of the expression
+	virtual int reduce(Context& ctx) { return Quad::None; }
+	virtual void jumping(Context& ctx, int t, int f) {
+		emitjumps(ctx, Relop::None, reduce(ctx), Quad::None, t, f);
+	}
+	void emitjumps(Context& ctx, Relop rel, int x, int y, int t, int f) {
+		if (t != 0) {
+			Quad q(Opcode::If, Quad::None, x, y);
+			q.rel = rel; q.label = t;
+			ctx.emit(q);
+			if (f != 0) ctx.emitgoto(f);
 		}
 		else if (f != 0) {
-			ss << "iffalse " << test << " goto L" << f;
-			emit(ss.str());
+			Quad q(Opcode::IfFalse, Quad::None, x, y);
+			q.rel = rel; q.label = f;
+			ctx.emit(q);
 		}
 	}
 
-	virtual std::string toString() { return op->toString(); }
-};
-
-/*
-	Node of temporary variables for three-address code?
-	(Not included into an AST)
-*/
-class Temp : public Expr {
-public:
-	Temp(std::shared_ptr<Type> p) : Expr(Word::Temp, p), number(++count) {}
-
-	static int count;
-	int number;
-	std::string toString() override { 
-		std::stringstream ss;
-		ss << 't' << number;
-		return ss.str(); 
+	// Appends the text preceding operand i, or following the last operand
+	virtual void print(std::string& s, size_t i) { s += op->toString(); }
+
+	std::string toString() {
+		struct Frame { Expr* x; std::vector<Node*> c; size_t i; };
+		std::string s;
+		std::vector<Frame> stack;
+		stack.push_back({ this, children(), 0 });
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			f.x->print(s, f.i);
+			if (f.i < f.c.size()) {
+				Expr* x = static_cast<Expr*>(f.c[f.i++]);
+				stack.push_back({ x, x->children(), 0 });
+			}
+			else stack.pop_back();
+		}
+		return s;
 	}
 };
 
-int Temp::count = 0;
-
 /*
 	Node of an operator with two operands
 */
 class Op : public Expr {
 public:
 	Op(std::shared_ptr<Token> t, std::shared_ptr<Type> p) : Expr(t, p) {}
-	std::shared_ptr<Expr> reduce() override {
-		std::shared_ptr<Expr> x = gen();
-		std::shared_ptr<Temp> t = std::make_shared<Temp>(type);
+	int reduce(Context& ctx) override {
+		// A shared subexpression is computed once per basic block
+		int t = ctx.values.find(this);
+		if (t != Quad::None) return t;
+
+		// Reduce the operators below bottom-up first, so that gen finds
+		// its operands in the value table instead of recursing into them
+		std::vector<std::pair<Op*, size_t> > stack = { { this, 0 } };
+		while (!stack.empty()) {
+			Op* x = stack.back().first;
+			std::vector<Node*> c = x->children();
+			size_t i = stack.back().second++;
+			if (i < c.size()) {
+				Op* y = dynamic_cast<Op*>(c[i]);
+				if (y != nullptr && ctx.values.find(y) == Quad::None) stack.push_back({ y, 0 });
+			}
+			else {
+				stack.pop_back();
+				if (x != this) x->reduce(ctx);
+			}
+		}
 
-		emit(t->toString() + " = " + x->toString());
+		Quad q = gen(ctx);
+		q.dest = t = ctx.newtemp(type);
+		ctx.emit(q);
+		ctx.values.put(this, t, children());
 		return t;
 	}
 };
@@ -122,33 +206,46 @@ public:
 		if (type == nullptr) error("type error");
 	}
 
-	json toJson() override {
-		json a = expr1->toJson();
-		json b = expr2->toJson();
+	~Arith() { release(); }
+
+	std::vector<Node*> children() override { return { expr1.get(), expr2.get() }; }
 
-		json j = { { "name", "Arith" }, {"op", op->toString()}, {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "Arith" }, {"op", op->toString()} };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Arith\\nop: " << op->toString() << "\"" << ", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr1->toDot(ss) << std::endl;;
-		ss << '\t' << i << " -> " << expr2->toDot(ss) << std::endl;;
-
 		return i;
 	}
 
-	std::shared_ptr<Expr> gen() override {
-		auto x1 = expr1->reduce();
-		auto x2 = expr2->reduce();
-		return std::make_shared<Arith>(op, x1, x2);
+	Quad gen(Context& ctx) override {
+		int x1 = expr1->reduce(ctx);
+		int x2 = expr2->reduce(ctx);
+		return Quad(opcode(), Quad::None, x1, x2);
+	}
+
+	Opcode opcode() {
+		switch (op->tag) {
+		case '+': return Opcode::Add;
+		case '-': return Opcode::Sub;
+		case '*': return Opcode::Mul;
+		default: return Opcode::Div;
+		}
+	}
+
+	void print(std::string& s, size_t i) override {
+		if (i == 1) s += " " + op->toString() + " ";
 	}
 
-	std::string toString() override {
-		return expr1->toString() + " " + op->toString() + " " + expr2->toString();
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr1));
+		nodes.push_back(std::move(expr2));
 	}
 };
 
@@ -163,29 +260,34 @@ public:
 		if (type == nullptr) error("type error");
 	}
 
-	json toJson() override {
-		json a = expr->toJson();
+	~Unary() { release(); }
+
+	std::vector<Node*> children() override { return { expr.get() }; }
 
-		json j = { { "name", "Unary" }, {"children", { a }} };
+	json toJsonNode() override {
+		json j = { { "name", "Unary" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Unary\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;;
-
 		return i;
 	}
 
-	std::shared_ptr<Expr> gen() override {
-		return std::make_shared<Unary>(op, expr->reduce());
+	Quad gen(Context& ctx) override {
+		return Quad(Opcode::Neg, Quad::None, expr->reduce(ctx));
+	}
+
+	void print(std::string& s, size_t i) override {
+		if (i == 0) s += op->toString() + " ";
 	}
 
-	std::string toString() override {
-		return op->toString() + " " + expr->toString();
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr));
 	}
 };
 
@@ -197,37 +299,33 @@ public:
 	Constant(std::shared_ptr<Token> t, std::shared_ptr<Type> p) : Expr(t, p) {}
 	Constant(int i) : Expr(std::make_shared<Num>(i), Type::Int) {}
 	
-	static std::shared_ptr<Constant> True;
-	static std::shared_ptr<Constant> False;
+	static const std::shared_ptr<Constant> True;
+	static const std::shared_ptr<Constant> False;
 
-	json toJson() override {
+	json toJsonNode() override {
 		json j = { { "name", "Constant" }, {"val", op->toString()} };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t id = hash(this);
 		ss << '\t' << id << ' ' << "[shape=box, label=\"Const\\nval: " << op->toString() << "\"" << ", fillcolor=\"#f1f8e9\", style=filled]" << std::endl;
 		return id;
 	}
 
-	void jumping(int t, int f) override {
-		std::stringstream ss;
-		if (this == True.get() && t != 0) {
-			ss << "goto L" << t;
-			emit(ss.str());
-		}
-		else if (this == False.get() && f != 0) {
-			ss << "goto L" << f;
-			emit(ss.str());
-		}
+	int reduce(Context& ctx) override {
+		int i = ctx.code.find(this);
+		return i != Quad::None ? i : ctx.code.constant(this, op->toString(), type);
 	}
 
-
+	void jumping(Context& ctx, int t, int f) override {
+		if (this == True.get() && t != 0) ctx.emitgoto(t);
+		else if (this == False.get() && f != 0) ctx.emitgoto(f);
+	}
 };
 
-std::shared_ptr<Constant> Constant::True  = std::make_shared<Constant>(Word::True, Type::Bool);
-std::shared_ptr<Constant> Constant::False = std::make_shared<Constant>(Word::False, Type::Bool);
+const std::shared_ptr<Constant> Constant::True  = std::make_shared<Constant>(Word::True, Type::Bool);
+const std::shared_ptr<Constant> Constant::False = std::make_shared<Constant>(Word::False, Type::Bool);
 
 /*
 	Node of an identifier
@@ -237,18 +335,23 @@ public:
 	Id(std::shared_ptr<Word> id, std::shared_ptr<Type> p, int b) : Expr(id, p), offset(b) {}
 	int offset;
 
-	json toJson() override {
+	json toJsonNode() override {
 		json j = { { "name", "Id" }, {"var", op->toString()} };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		Id* temp = new Id(*this);
-		uint32_t id = hash(temp) + ss.str().size();
+		uint32_t id = hash(temp) + (uint32_t)ss.tellp();
 		delete temp;
 		ss << '\t' << id << ' ' << "[shape=box, label=\"Id\\nvar: " << op->toString() << "\"" << ", fillcolor=\"#f1f8e9\", style=filled]" << std::endl;
 		return id;
 	}
+
+	int reduce(Context& ctx) override {
+		int i = ctx.code.find(this);
+		return i != Quad::None ? i : ctx.code.var(this, op->toString(), type);
+	}
 };
 
 /*
@@ -261,6 +364,10 @@ public:
 
 	}
 
+	~Logical() { release(); }
+
+	std::vector<Node*> children() override { return { expr1.get(), expr2.get() }; }
+
 	virtual std::shared_ptr<Type> check(std::shared_ptr<Type> p1, std::shared_ptr<Type> p2) {
 		if (p1 == Type::Bool && p2 == Type::Bool) return Type::Bool;
 		else {
@@ -269,43 +376,58 @@ public:
 		}
 	}
 
-	json toJson() override {
-		json a = expr1->toJson();
-		json b = expr2->toJson();
-
-		json j = { { "name", "Logical" }, {"op", op->toString()},  {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "Logical" }, {"op", op->toString()} };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Logical\\nop: " << op->toString() << "\"" << ", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr1->toDot(ss) << std::endl;;
-		ss << '\t' << i << " -> " << expr2->toDot(ss) << std::endl;;
-
 		return i;
 	}
 
-	std::shared_ptr<Expr> gen() override {
-		std::stringstream ss;
-		int f = newlabel(); int a = newlabel();
-		std::shared_ptr<Temp> t = std::make_shared<Temp>(type);
-		this->jumping(0, f);
-		ss << t->toString() << " = true";
-		emit(ss.str()); ss.clear();
-		ss << "goto L" << a;
-		emit(ss.str()); ss.clear();
-		emitlabel(f);
-		ss << t->toString() << " = false";
-		emit(ss.str()); ss.clear();
-		emitlabel(a);
+	// Computes the value of the expression into a temporary with jumps
+	int reduce(Context& ctx) override {
+		int f = ctx.newlabel(); int a = ctx.newlabel();
+		int t = ctx.newtemp(type);
+		this->jumping(ctx, 0, f);
+		ctx.emit(Quad(Opcode::Copy, t, Constant::True->reduce(ctx)));
+		ctx.emitgoto(a);
+		ctx.emitlabel(f);
+		ctx.emit(Quad(Opcode::Copy, t, Constant::False->reduce(ctx)));
+		ctx.emitlabel(a);
 		return t;
 	}
 
-	std::string toString() override {
-		return expr1->toString() + " " + op->toString() + " " + expr2->toString();
+	void print(std::string& s, size_t i) override {
+		if (i == 1) s += " " + op->toString() + " ";
+	}
+
+protected:
+	// A jump to generate for an operand, or a label to emit if expr is null
+	struct Jump { Expr* expr; int t, f; };
+
+	// Replaces the jumps of the operator by the jumps of its operands,
+	// returns false if the operator generates its own jumps
+	virtual bool split(Context& ctx, int t, int f, std::vector<Jump>& work) { return false; }
+
+	// Generates the jumps of nested And, Or and Not with an explicit stack
+	void jumps(Context& ctx, int t, int f) {
+		std::vector<Jump> work = { { this, t, f } };
+		while (!work.empty()) {
+			Jump j = work.back(); work.pop_back();
+			Logical* x = dynamic_cast<Logical*>(j.expr);
+			if (j.expr == nullptr) ctx.emitlabel(j.t);
+			else if (x == nullptr || !x->split(ctx, j.t, j.f, work)) j.expr->jumping(ctx, j.t, j.f);
+		}
+	}
+
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr1));
+		nodes.push_back(std::move(expr2));
 	}
 };
 
@@ -317,12 +439,15 @@ public:
 	Or(std::shared_ptr<Token> t, std::shared_ptr<Expr> x1, std::shared_ptr<Expr> x2) : Logical(t, x1, x2) {
 		type = check(x1->type, x2->type);
 	}
-	void jumping(int t, int f) override {
-		int label = t != 0 ? t : newlabel();
-		expr1->jumping(label, 0);
-		expr2->jumping(t, f);
-		if (t == 0) emitlabel(label);
+	void jumping(Context& ctx, int t, int f) override { jumps(ctx, t, f); }
 
+protected:
+	bool split(Context& ctx, int t, int f, std::vector<Jump>& work) override {
+		int label = t != 0 ? t : ctx.newlabel();
+		if (t == 0) work.push_back({ nullptr, label, 0 });
+		work.push_back({ expr2.get(), t, f });
+		work.push_back({ expr1.get(), label, 0 });
+		return true;
 	}
 };
 
@@ -334,12 +459,15 @@ public:
 	And(std::shared_ptr<Token> t, std::shared_ptr<Expr> x1, std::shared_ptr<Expr> x2) : Logical(t, x1, x2) {
 		type = check(x1->type, x2->type);
 	}
-	void jumping(int t, int f) override {
-		int label = f != 0 ? f : newlabel();
-		expr1->jumping(label, 0);
-		expr2->jumping(t, f);
-		if (f == 0) emitlabel(label);
+	void jumping(Context& ctx, int t, int f) override { jumps(ctx, t, f); }
 
+protected:
+	bool split(Context& ctx, int t, int f, std::vector<Jump>& work) override {
+		int label = f != 0 ? f : ctx.newlabel();
+		if (f == 0) work.push_back({ nullptr, label, 0 });
+		work.push_back({ expr2.get(), t, f });
+		work.push_back({ expr1.get(), 0, label });
+		return true;
 	}
 };
 
@@ -351,11 +479,18 @@ public:
 	Not(std::shared_ptr<Token> t,  std::shared_ptr<Expr> x2) : Logical(t, x2, x2) {
 		type = check(x2->type, x2->type);
 	}
-	void jumping(int t, int f) override {
-		expr2->jumping(f, t);
+	std::vector<Node*> children() override { return { expr2.get() }; }
+
+	void jumping(Context& ctx, int t, int f) override { jumps(ctx, t, f); }
+
+	void print(std::string& s, size_t i) override {
+		if (i == 0) s += op->toString() + " ";
 	}
-	std::string toString() override {
-		return op->toString() + " " + expr2->toString();
+
+protected:
+	bool split(Context& ctx, int t, int f, std::vector<Jump>& work) override {
+		work.push_back({ expr2.get(), f, t });
+		return true;
 	}
 };
 
@@ -368,22 +503,16 @@ public:
 		type = check(x1->type, x2->type);
 	}
 
-	json toJson() override {
-		json a = expr1->toJson();
-		json b = expr2->toJson();
-
-		json j = { { "name", "Rel" }, {"op", op->toString()}, {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "Rel" }, {"op", op->toString()} };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Rel\\nop: " << op->toString() << "\"" << ", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr1->toDot(ss) << std::endl;;
-		ss << '\t' << i << " -> " << expr2->toDot(ss) << std::endl;;
-
 		return i;
 	}
 
@@ -395,11 +524,21 @@ public:
 		else return nullptr;
 	}
 
-	void jumping(int t, int f) override {
-		std::shared_ptr<Expr> a = expr1->reduce();
-		std::shared_ptr<Expr> b = expr2->reduce();
-		std::string test = a->toString() + " " + op->toString() + " " + b->toString();
-		emitjumps(test, t, f);
+	void jumping(Context& ctx, int t, int f) override {
+		int a = expr1->reduce(ctx);
+		int b = expr2->reduce(ctx);
+		emitjumps(ctx, relop(), a, b, t, f);
+	}
+
+	Relop relop() {
+		switch (op->tag) {
+		case '<': return Relop::Lt;
+		case LE: return Relop::Le;
+		case '>': return Relop::Gt;
+		case GE: return Relop::Ge;
+		case EQ: return Relop::Eq;
+		default: return Relop::Ne;
+		}
 	}
 };
 /*
@@ -412,35 +551,37 @@ public:
 	std::shared_ptr<Id> arr;
 	std::shared_ptr<Expr> index;
 
-	json toJson() override {
-		json a = arr->toJson();
-		//json b = index->toJson(); // infinite loop
+	~Access() { release(); }
+
+	std::vector<Node*> children() override { return { arr.get(), index.get() }; }
 
-		json j = { { "name", "Access" }, {"children", { a }} };
+	json toJsonNode() override {
+		json j = { { "name", "Access" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Access\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << arr->toDot(ss) << std::endl;
-		//ss << '\t' << i << " -> " << index->toDot(ss) << std::endl; // infinite loop
-
 		return i;
 	}
 
-	std::shared_ptr<Expr> gen() override {
-		return std::make_shared<Access>(arr, index->reduce(), type);
+	Quad gen(Context& ctx) override {
+		int i = index->reduce(ctx);
+		return Quad(Opcode::Load, Quad::None, arr->reduce(ctx), i);
 	}
 
-	void jumping(int t, int f) override {
-		emitjumps(reduce()->toString(), t, f);
+	void print(std::string& s, size_t i) override {
+		if (i == 1) s += " [ ";
+		else if (i == 2) s += " ]";
 	}
 
-	std::string toString() override {
-		return arr->toString() + " [ " + index->toString() + " ]";
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(arr));
+		nodes.push_back(std::move(index));
 	}
 };
 
@@ -450,16 +591,16 @@ public:
 class Stmt : public Node {
 public:
 	Stmt() = default;
-	static std::shared_ptr<Stmt> Null; // Empty statement
+	static const std::shared_ptr<Stmt> Null; // Empty statement
 
-	json toJson() override {
+	json toJsonNode() override {
 		if (this == Null.get()) return json({ {"name", "Empty" } });
 		else return json({ {"name", "Stmt" } });
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		if (this == Null.get()) {
-			uint32_t id = hash(this) + ss.str().size();
+			uint32_t id = hash(this) + (uint32_t)ss.tellp();
 			ss << '\t' << id << ' ' << "[shape=box, label=\"Empty\", fillcolor=\"#eceff1\", style=filled]" << std::endl;
 			return id;
 		}
@@ -471,13 +612,11 @@ public:
 	}
 
 	// For generating intermediate three-address code?
-	static std::shared_ptr<Stmt> Enclosing;
-	virtual void gen(int b, int a) {}
+	virtual void gen(Context& ctx, int b, int a) {}
 	int after;
 };
 
-std::shared_ptr<Stmt> Stmt::Null	  = std::make_shared<Stmt>();
-std::shared_ptr<Stmt> Stmt::Enclosing = Null;
+const std::shared_ptr<Stmt> Stmt::Null = std::make_shared<Stmt>();
 
 /*
 	If-condition statement node
@@ -491,30 +630,34 @@ public:
 	std::shared_ptr<Expr> expr;
 	std::shared_ptr<Stmt> stmt;
 
-	json toJson() override {
-		json a = expr->toJson();
-		json b = stmt->toJson();
+	~If() { release(); }
+
+	std::vector<Node*> children() override { return { expr.get(), stmt.get() }; }
 
-		json j = { { "name", "If" }, {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "If" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"If\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << stmt->toDot(ss) << std::endl;
-
 		return i;
 	}
 
-	void gen(int b, int a) override {
-		int label = newlabel();
-		expr->jumping(0, a);
-		emitlabel(label);
-		stmt->gen(label, a);
+	void gen(Context& ctx, int b, int a) override {
+		int label = ctx.newlabel();
+		expr->jumping(ctx, 0, a);
+		ctx.emitlabel(label);
+		stmt->gen(ctx, label, a);
+	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr));
+		nodes.push_back(std::move(stmt));
 	}
 };
 
@@ -529,39 +672,39 @@ public:
 		if (x->type != Type::Bool) x->error("Boolean required in If-Else");
 	}
 
-	json toJson() override {
-		json a = expr->toJson();
-		json b = stmt1->toJson();
-		auto c = stmt2->toJson();
+	~Else() { release(); }
+
+	std::vector<Node*> children() override { return { expr.get(), stmt1.get(), stmt2.get() }; }
 
-		json j = { { "name", "If-Else" }, {"children", { a, b, c }} };
+	json toJsonNode() override {
+		json j = { { "name", "If-Else" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"If-Else\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << stmt1->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << stmt2->toDot(ss) << std::endl;
-
-
 		return i;
 	}
 
-	void gen(int b, int a) override {
-		std::stringstream ss;
-		int label1 = newlabel();
-		int label2 = newlabel();
-		expr->jumping(0, label2);
-		emitlabel(label1);
-		stmt1->gen(label1, a);
-		ss << "goto L" << a;
-		emit(ss.str());
-		emitlabel(label2);
-		stmt2->gen(label2, a);
+	void gen(Context& ctx, int b, int a) override {
+		int label1 = ctx.newlabel();
+		int label2 = ctx.newlabel();
+		expr->jumping(ctx, 0, label2);
+		ctx.emitlabel(label1);
+		stmt1->gen(ctx, label1, a);
+		ctx.emitgoto(a);
+		ctx.emitlabel(label2);
+		stmt2->gen(ctx, label2, a);
+	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr));
+		nodes.push_back(std::move(stmt1));
+		nodes.push_back(std::move(stmt2));
 	}
 };
 
@@ -580,34 +723,36 @@ public:
 		if (x->type != Type::Bool) x->error("Boolean required in While");
 	}
 
-	json toJson() override {
-		json a = expr->toJson();
-		json b = stmt->toJson();
+	~While() { release(); }
+
+	std::vector<Node*> children() override { return { expr.get(), stmt.get() }; }
 
-		json j = { { "name", "While" }, {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "While" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"While\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << stmt->toDot(ss) << std::endl;
-
 		return i;
 	}
 
-	void gen(int b, int a) override {
-		std::stringstream ss;
+	void gen(Context& ctx, int b, int a) override {
 		after = a;
-		expr->jumping(0, a);
-		int label = newlabel();
-		emitlabel(label);
-		stmt->gen(label, b);
-		ss << "goto L" << b;
-		emit(ss.str());
+		expr->jumping(ctx, 0, a);
+		int label = ctx.newlabel();
+		ctx.emitlabel(label);
+		stmt->gen(ctx, label, b);
+		ctx.emitgoto(b);
+	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr));
+		nodes.push_back(std::move(stmt));
 	}
 };
 
@@ -626,31 +771,35 @@ public:
 		if (x->type != Type::Bool) x->error("Boolean required in Do-While");
 	}
 
-	json toJson() override {
-		json a = expr->toJson();
-		json b = stmt->toJson();
+	~Do() { release(); }
 
-		json j = { { "name", "Do-While" }, {"children", { a, b }} };
+	std::vector<Node*> children() override { return { expr.get(), stmt.get() }; }
+
+	json toJsonNode() override {
+		json j = { { "name", "Do-While" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Do-While\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << stmt->toDot(ss) << std::endl;
-
 		return i;
 	}
 
-	void gen(int b, int a) override {
+	void gen(Context& ctx, int b, int a) override {
 		after = a;
-		int label = newlabel();
-		stmt->gen(b, label);
-		emitlabel(label);
-		expr->jumping(b, 0);
+		int label = ctx.newlabel();
+		stmt->gen(ctx, b, label);
+		ctx.emitlabel(label);
+		expr->jumping(ctx, b, 0);
+	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(expr));
+		nodes.push_back(std::move(stmt));
 	}
 };
 
@@ -666,22 +815,20 @@ public:
 	std::shared_ptr<Id> id;
 	std::shared_ptr<Expr> expr;
 
-	json toJson() override {
-		json a = id->toJson();
-		json b = expr->toJson();
+	~Set() { release(); }
+
+	std::vector<Node*> children() override { return { id.get(), expr.get() }; }
 
-		json j = { { "name", "Set" }, {"children", { a, b }} };
+	json toJsonNode() override {
+		json j = { { "name", "Set" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Assign\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << id->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-
 		return i;
 	}
 
@@ -691,8 +838,17 @@ public:
 		else return nullptr;
 	}
 
-	void gen(int b, int a) override {
-		emit(id->toString() + " = " + expr->gen()->toString());
+	void gen(Context& ctx, int b, int a) override {
+		Quad q = expr->gen(ctx);
+		q.dest = id->reduce(ctx);
+		ctx.emit(q);
+		ctx.values.kill(id.get());
+	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(id));
+		nodes.push_back(std::move(expr));
 	}
 };
 
@@ -708,25 +864,20 @@ public:
 		if (check(x->type, y->type) == nullptr) error("type error");
 	}
 
-	json toJson() override {
-		json a = arr->toJson();
-		json b = index->toJson();
-		json c = expr->toJson();
+	~SetElem() { release(); }
 
-		json j = { { "name", "SetElem" }, {"children", { a, b, c }} };
+	std::vector<Node*> children() override { return { arr.get(), index.get(), expr.get() }; }
+
+	json toJsonNode() override {
+		json j = { { "name", "SetElem" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"SetElem\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << arr->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << index->toDot(ss) << std::endl;
-		ss << '\t' << i << " -> " << expr->toDot(ss) << std::endl;
-
-
 		return i;
 	}
 
@@ -739,11 +890,18 @@ public:
 		else return nullptr;
 	}
 
-	void gen(int b, int a) override {
-		std::string s1 = index->reduce()->toString();
-		std::string s2 = expr->reduce()->toString();
+	void gen(Context& ctx, int b, int a) override {
+		int x = index->reduce(ctx);
+		int y = expr->reduce(ctx);
+		ctx.emit(Quad(Opcode::Store, arr->reduce(ctx), x, y));
+		ctx.values.kill(arr.get());
+	}
 
-		emit(arr->toString() + " [ " + s1 + " ] = " + s2);
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(arr));
+		nodes.push_back(std::move(index));
+		nodes.push_back(std::move(expr));
 	}
 };
 
@@ -756,35 +914,39 @@ public:
 	std::shared_ptr<Stmt> stmt2;
 	Seq(std::shared_ptr<Stmt> s1, std::shared_ptr<Stmt> s2) : stmt1(s1), stmt2(s2) {}
 
-	json toJson() override {
-		json s1 = stmt1->toJson();
-		json s2 = stmt2->toJson();
+	~Seq() { release(); }
+
+	std::vector<Node*> children() override { return { stmt1.get(), stmt2.get() }; }
 
-		json j = { { "name", "Seq" }, {"children", { s1, s2 }} };
+	json toJsonNode() override {
+		json j = { { "name", "Seq" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Seq\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
 
-		ss << '\t' << i << " -> " << stmt1->toDot(ss) << std::endl;;
-		ss << '\t' << i << " -> " << stmt2->toDot(ss) << std::endl;;
-
 		return i;
 	}
 
-	void gen(int b, int a) override {
-		if (stmt1 == Stmt::Null) stmt2->gen(b, a);
-		else if (stmt2 == Stmt::Null) stmt1->gen(b, a);
+	void gen(Context& ctx, int b, int a) override {
+		if (stmt1 == Stmt::Null) stmt2->gen(ctx, b, a);
+		else if (stmt2 == Stmt::Null) stmt1->gen(ctx, b, a);
 		else {
-			int label = newlabel();
-			stmt1->gen(b, label);
-			emitlabel(label);
-			stmt2->gen(label, a);
+			int label = ctx.newlabel();
+			stmt1->gen(ctx, b, label);
+			ctx.emitlabel(label);
+			stmt2->gen(ctx, label, a);
 		}
 	}
+
+protected:
+	void detach(std::vector<std::shared_ptr<Node> >& nodes) override {
+		nodes.push_back(std::move(stmt1));
+		nodes.push_back(std::move(stmt2));
+	}
 };
 
 /*
@@ -793,17 +955,17 @@ public:
 class Break : public Stmt {
 public:
 	std::shared_ptr<Stmt> stmt;
-	Break() {
-		if (Stmt::Enclosing == nullptr) error("Unenclosed break");
-		stmt = Stmt::Enclosing;
+	Break(std::shared_ptr<Stmt> enclosing) {
+		if (enclosing == Stmt::Null) error("Unenclosed break");
+		stmt = enclosing;
 	}
 
-	json toJson() override {
+	json toJsonNode() override {
 		json j = { { "name", "Break" } };
 		return j;
 	}
 
-	uint32_t toDot(std::stringstream& ss) override {
+	uint32_t toDotNode(std::stringstream& ss) override {
 		uint32_t i = hash(this);
 
 		ss << '\t' << i << ' ' << "[shape=box, label=\"Break\", fillcolor=\"#e3f2fd\", style=filled]" << std::endl;
@@ -811,10 +973,8 @@ public:
 		return i;
 	}
 	
-	void gen(int b, int a) override {
-		std::stringstream ss;
-		ss << "goto L" << stmt->after;
-		emit(ss.str());
+	void gen(Context& ctx, int b, int a) override {
+		ctx.emitgoto(stmt->after);
 	}
 };
 
@@ -0,0 +1,139 @@
+#pragma once
+#include "IR.h"
+#include <stdexcept>
+#include <unordered_map>
+
+/*
+	Interpreter of the three-address code, counting the instructions it
+	executes. Values are kept as doubles, arithmetic on operands that are
+	not float truncates to integers and division by zero gives zero.
+	Variables and array elements start at zero. A vector instruction runs
+	on all its lanes at once, as one instruction. A failed check throws
+*/
+class Interpreter {
+public:
+	size_t steps = 0; // Instructions executed, labels excluded
+	std::vector<size_t> counts; // Instructions executed of each opcode
+
+	Interpreter(const Code& c) : counts((size_t)Opcode::Check + 1, 0), code(c), values(c.operands.size(), 0), lanes(c.operands.size()), memory(c.operands.size()) {
+		for (size_t i = 0; i < code.quads.size(); i++) {
+			const Quad& q = code.quads[i];
+			if (q.op != Opcode::Label) continue;
+			if (q.label >= (int)targets.size()) targets.resize(q.label + 1, -1);
+			targets[q.label] = (int)i;
+		}
+		for (size_t x = 0; x < code.operands.size(); x++) {
+			const Operand& o = code.operands[x];
+			lanes[x].resize(code.lanes((int)x), 0);
+			if (o.kind != Operand::Const) continue;
+			if (o.type == Type::Bool) values[x] = o.name == "true";
+			else values[x] = std::stod(o.name);
+		}
+	}
+
+	// Runs the code from the start, returns false if it is stopped after
+	// limit instructions
+	bool run(size_t limit = SIZE_MAX) {
+		const std::vector<Quad>& quads = code.quads;
+		size_t pc = 0;
+		while (pc < quads.size()) {
+			const Quad& q = quads[pc++];
+			if (q.op == Opcode::Label) continue;
+			if (++steps > limit) return false;
+			counts[(size_t)q.op]++;
+			switch (q.op) {
+			case Opcode::Copy: values[q.dest] = values[q.src1]; lanes[q.dest] = lanes[q.src1]; break;
+			case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div: case Opcode::Neg:
+				values[q.dest] = arith(q.op, values[q.src1], q.src2 != Quad::None ? values[q.src2] : 0, code.operands[q.dest].type == Type::Float);
+				break;
+			case Opcode::Load: values[q.dest] = element(q.src1, (long long)values[q.src2]); break;
+			case Opcode::Store: memory[q.dest][(long long)values[q.src1]] = values[q.src2]; break;
+			case Opcode::Goto: pc = targets[q.label]; break;
+			case Opcode::If: case Opcode::IfFalse:
+				if (condition(q) == (q.op == Opcode::If)) pc = targets[q.label];
+				break;
+			case Opcode::VLoad: case Opcode::VStore: case Opcode::VAdd: case Opcode::VSub: case Opcode::VMul: case Opcode::VSplat:
+				vector(q);
+				break;
+			case Opcode::Check: {
+				long long offset = (long long)values[q.src2];
+				const Type& array = *code.operands[q.src1].type;
+				if (offset < 0 || offset + Code::element(array) > array.width) {
+					throw std::out_of_range("Offset " + std::to_string(offset) + " out of bounds of " + code.name(q.src1));
+				}
+				break;
+			}
+			default: break;
+			}
+		}
+		return true;
+	}
+
+	double value(int x) const { return values[x]; }
+
+	double element(int array, long long offset) const {
+		auto found = memory[array].find(offset);
+		return found != memory[array].end() ? found->second : 0;
+	}
+
+private:
+	const Code& code;
+	std::vector<int> targets; // Instruction of each label
+	std::vector<double> values;
+	std::vector<std::vector<double> > lanes; // Values of the vector temporaries
+	std::vector<std::unordered_map<long long, double> > memory; // Elements of each array by offset
+
+	double arith(Opcode op, double a, double b, bool real) const {
+		if (real) {
+			switch (op) {
+			case Opcode::Add: return a + b;
+			case Opcode::Sub: return a - b;
+			case Opcode::Mul: return a * b;
+			case Opcode::Div: return b != 0 ? a / b : 0;
+			default: return -a;
+			}
+		}
+		long long x = (long long)a, y = (long long)b;
+		switch (op) {
+		case Opcode::Add: return (double)(x + y);
+		case Opcode::Sub: return (double)(x - y);
+		case Opcode::Mul: return (double)(x * y);
+		case Opcode::Div: return y != 0 ? (double)(x / y) : 0;
+		default: return (double)-x;
+		}
+	}
+
+	// Lane k of operand x, a scalar is in every lane
+	double lane(int x, int k) const { return lanes[x].empty() ? values[x] : lanes[x][k]; }
+
+	// Runs a vector instruction on the lanes of its vector operand, the
+	// elements of the array taken at the offsets of consecutive elements
+	void vector(const Quad& q) {
+		int v = q.op == Opcode::VStore ? q.src2 : q.dest;
+		const Array& a = static_cast<const Array&>(*code.operands[v].type);
+		int w = a.of->width;
+		for (int k = 0; k < a.size; k++) {
+			switch (q.op) {
+			case Opcode::VLoad: lanes[v][k] = element(q.src1, (long long)values[q.src2] + k * w); break;
+			case Opcode::VStore: memory[q.dest][(long long)values[q.src1] + k * w] = lane(v, k); break;
+			case Opcode::VAdd: lanes[v][k] = arith(Opcode::Add, lane(q.src1, k), lane(q.src2, k), a.of == Type::Float); break;
+			case Opcode::VSub: lanes[v][k] = arith(Opcode::Sub, lane(q.src1, k), lane(q.src2, k), a.of == Type::Float); break;
+			case Opcode::VMul: lanes[v][k] = arith(Opcode::Mul, lane(q.src1, k), lane(q.src2, k), a.of == Type::Float); break;
+			default: lanes[v][k] = values[q.src1]; break;
+			}
+		}
+	}
+
+	bool condition(const Quad& q) const {
+		double a = values[q.src1], b = q.rel != Relop::None ? values[q.src2] : 0;
+		switch (q.rel) {
+		case Relop::Lt: return a < b;
+		case Relop::Le: return a <= b;
+		case Relop::Gt: return a > b;
+		case Relop::Ge: return a >= b;
+		case Relop::Eq: return a == b;
+		case Relop::Ne: return a != b;
+		default: return a != 0;
+		}
+	}
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "Analyses.h"
+
+/*
+	Cleans up the jumps of the generated code: a jump to a label followed
+	by a goto is threaded to the final target, a jump to the label right
+	after it is removed, and so are the labels no jump refers to
+*/
+class Jumps {
+public:
+	// Returns the number of instructions removed
+	static int run(Code& code, Analyses& analyses) {
+		std::vector<Quad>& quads = code.quads;
+		int n = (int)quads.size();
+
+		// Position of each label and the first label of its run, labels
+		// of one run name the same place
+		int count = 0;
+		for (Quad& q : quads) count = std::max(count, q.label + 1);
+		std::vector<int> at(count, -1), leader(count, -1);
+		for (int i = 0; i < n; i++) {
+			if (quads[i].op != Opcode::Label) continue;
+			at[quads[i].label] = i;
+			bool first = i == 0 || quads[i - 1].op != Opcode::Label;
+			leader[quads[i].label] = first ? quads[i].label : leader[quads[i - 1].label];
+		}
+
+		// Final target of each label, following chains of gotos. A chain
+		// that loops ends at the label where it closes
+		std::vector<int> target(count, -1);
+		std::vector<char> visiting(count, 0);
+		std::vector<int> path;
+		for (int l = 0; l < count; l++) {
+			if (at[l] < 0 || target[l] >= 0) continue;
+			int x = l;
+			path.clear();
+			while (target[x] < 0 && !visiting[x]) {
+				visiting[x] = 1;
+				path.push_back(x);
+				int g = next(quads, at[x]);
+				if (g < 0 || quads[g].op != Opcode::Goto || at[quads[g].label] < 0) {
+					target[x] = leader[x];
+					break;
+				}
+				x = quads[g].label;
+			}
+			int result = target[x] >= 0 ? target[x] : leader[x];
+			for (int p : path) { target[p] = result; visiting[p] = 0; }
+		}
+
+		// Thread the jumps, and drop the ones to the following label
+		std::vector<char> removed(n, 0);
+		std::vector<char> used(count, 0);
+		bool threaded = false;
+		for (int i = 0; i < n; i++) {
+			Quad& q = quads[i];
+			if (!q.jump() || at[q.label] < 0) continue;
+			threaded = threaded || q.label != target[q.label];
+			q.label = target[q.label];
+			if (i + 1 < n && quads[i + 1].op == Opcode::Label && leader[quads[i + 1].label] == q.label) removed[i] = 1;
+			else used[q.label] = 1;
+		}
+
+		// Remove the labels without jumps to them
+		int j = 0;
+		for (int i = 0; i < n; i++) {
+			if (removed[i] || (quads[i].op == Opcode::Label && !used[quads[i].label])) continue;
+			quads[j++] = quads[i];
+		}
+		quads.erase(quads.begin() + j, quads.end());
+		if (threaded || j < n) analyses.invalidate(Analyses::Graph);
+		return n - j;
+	}
+
+private:
+	// Position of the first instruction after the label at i
+	static int next(const std::vector<Quad>& quads, int i) {
+		while (i < (int)quads.size() && quads[i].op == Opcode::Label) i++;
+		return i < (int)quads.size() ? i : -1;
+	}
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include "Analyses.h"
+
+/*
+	Block layout. The blocks are chained along their heaviest edges, an
+	edge weighing more the deeper the loops it stays in, so that a block
+	falls through into its successor instead of jumping to it. A
+	conditional jump whose target comes next is inverted to fall into it,
+	a goto to the next block is dropped, and the blocks holding only a
+	goto are bypassed. The entry stays first
+*/
+class Layout {
+public:
+	// Returns the number of jumps removed, less the ones added
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		std::vector<Quad>& quads = code.quads;
+		const CFG& cfg = analyses.cfg();
+		const Loops& nest = analyses.loops();
+		int count = (int)cfg.blocks.size(), end = count; // The place after the code
+		int jumps = 0, label = 0;
+		for (const Quad& q : quads) {
+			jumps += q.jump();
+			label = std::max(label, q.label);
+		}
+
+		// Jump ending each block and the blocks it goes to, a block holding
+		// only a goto forwards to its target
+		std::vector<int> last(count, -1), taken(count, -1), fall(count, -1), forward(count + 1);
+		for (int b = 0; b <= count; b++) forward[b] = b;
+		for (int b = 0; b < count; b++) {
+			const CFG::Block& k = cfg.blocks[b];
+			const Quad& q = quads[k.end - 1];
+			if (q.jump()) { last[b] = k.end - 1; taken[b] = cfg.labels[q.label]; }
+			if (q.op != Opcode::Goto) fall[b] = b + 1;
+			if (b > 0 && q.op == Opcode::Goto) {
+				int i = k.begin;
+				while (quads[i].op == Opcode::Label) i++;
+				if (i == k.end - 1) forward[b] = taken[b];
+			}
+		}
+		auto bypass = [&](int b) {
+			for (int k = 0; k < count && forward[b] != b; k++) b = forward[b];
+			return b;
+		};
+		for (int b = 0; b < count; b++) {
+			if (taken[b] >= 0) taken[b] = bypass(taken[b]);
+			if (fall[b] >= 0) fall[b] = bypass(fall[b]);
+			if (taken[b] >= 0 && taken[b] == fall[b]) { taken[b] = -1; last[b] = -1; }
+		}
+
+		// Blocks still entered, the ones bypassed or never reached are left out
+		std::vector<char> seen(count + 1, 0);
+		std::vector<int> work = { 0 };
+		seen[0] = 1;
+		while (!work.empty()) {
+			int b = work.back(); work.pop_back();
+			for (int s : { taken[b], fall[b] }) {
+				if (s >= 0 && !seen[s]) { seen[s] = 1; if (s != end) work.push_back(s); }
+			}
+		}
+
+		// Edges by weight, an edge in a loop weighs eight times one out of it
+		// and a fall-through wins a tie
+		std::vector<int> depth(count, 0);
+		for (int b = 0; b < count; b++) {
+			for (int l = nest.innermost[b]; l >= 0; l = nest.loops[l].parent) depth[b]++;
+		}
+		struct Edge { int from, to; long long weight; bool falls; };
+		std::vector<Edge> edges;
+		for (int b = 0; b < count; b++) {
+			if (!seen[b]) continue;
+			for (int s : { fall[b], taken[b] }) {
+				if (s < 0 || s == end) continue;
+				long long weight = 1LL << (3 * std::min(std::min(depth[b], depth[s]), 20));
+				edges.push_back({ b, s, weight, s == fall[b] });
+			}
+		}
+		std::stable_sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+			return a.weight != b.weight ? a.weight > b.weight : a.falls > b.falls;
+		});
+
+		// Chains grow by joining the end of one to the start of another
+		std::vector<int> next(count, -1), chain(count);
+		std::vector<char> joined(count, 0);
+		for (int b = 0; b < count; b++) chain[b] = b;
+		auto find = [&](int b) {
+			while (chain[b] != b) b = chain[b] = chain[chain[b]];
+			return b;
+		};
+		for (const Edge& e : edges) {
+			if (next[e.from] >= 0 || joined[e.to] || e.to == 0 || find(e.from) == find(e.to)) continue;
+			next[e.from] = e.to;
+			joined[e.to] = 1;
+			chain[find(e.to)] = find(e.from);
+		}
+
+		// The chain of the entry first, then the others by their first block
+		// but for the one falling off the end of the code, placed last
+		std::vector<int> order;
+		int final = -1;
+		for (int h = 0; h < count; h++) {
+			if (!seen[h] || joined[h]) continue;
+			int b = h;
+			while (next[b] >= 0) b = next[b];
+			if (h > 0 && fall[b] == end && final < 0) { final = h; continue; }
+			for (b = h; b >= 0; b = next[b]) order.push_back(b);
+		}
+		for (int b = final; b >= 0; b = next[b]) order.push_back(b);
+
+		// Jumps to the blocks that do not come next
+		std::vector<std::vector<Quad> > exits(count);
+		std::vector<char> targeted(count + 1, 0);
+		auto jump = [&](std::vector<Quad>& list, Quad q, int target) {
+			q.label = target;
+			targeted[target] = 1;
+			list.push_back(q);
+		};
+		for (size_t k = 0; k < order.size(); k++) {
+			int b = order[k], n = k + 1 < order.size() ? order[k + 1] : end;
+			int f = fall[b] >= 0 ? fall[b] : -1, t = taken[b];
+			if (last[b] >= 0 && quads[last[b]].op != Opcode::Goto) {
+				Quad q = quads[last[b]];
+				if (f == n) jump(exits[b], q, t);
+				else if (t == n) {
+					q.op = q.op == Opcode::If ? Opcode::IfFalse : Opcode::If;
+					jump(exits[b], q, f);
+				}
+				else if (f < end && t < end && depth[f] > depth[t]) {
+					// Jumping on to the deeper block saves the goto in its loop
+					q.op = q.op == Opcode::If ? Opcode::IfFalse : Opcode::If;
+					jump(exits[b], q, f);
+					jump(exits[b], Quad(Opcode::Goto), t);
+				}
+				else {
+					jump(exits[b], q, t);
+					jump(exits[b], Quad(Opcode::Goto), f);
+				}
+			}
+			else {
+				int s = t >= 0 ? t : f;
+				if (s >= 0 && s != n) jump(exits[b], Quad(Opcode::Goto), s);
+			}
+		}
+
+		// A block keeps its first label if jumped to, or takes a new one
+		std::vector<int> labels(count + 1, -1);
+		for (int b = 0; b < count; b++) {
+			if (!targeted[b]) continue;
+			const Quad& first = quads[cfg.blocks[b].begin];
+			labels[b] = first.op == Opcode::Label ? first.label : ++label;
+		}
+		if (targeted[end]) labels[end] = ++label;
+
+		std::vector<Quad> result;
+		auto place = [&](int b) {
+			if (labels[b] < 0) return;
+			Quad q(Opcode::Label);
+			q.label = labels[b];
+			result.push_back(q);
+		};
+		int after = 0;
+		for (int b : order) {
+			place(b);
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (quads[i].op != Opcode::Label && !quads[i].jump()) result.push_back(quads[i]);
+			}
+			for (Quad q : exits[b]) {
+				q.label = labels[q.label];
+				result.push_back(q);
+				after++;
+			}
+		}
+		place(end);
+		quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return jumps - after;
+	}
+};
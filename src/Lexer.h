@@ -48,28 +48,28 @@ public:
 	Word(std::string s, int tag) : Token(tag), lexeme(s) {}
 	std::string toString() override { return lexeme; }
 
-	static std::shared_ptr<Word> And;
-	static std::shared_ptr<Word> Or;
-	static std::shared_ptr<Word> Eq;
-	static std::shared_ptr<Word> Ne;
-	static std::shared_ptr<Word> Le;
-	static std::shared_ptr<Word> Ge;
-	static std::shared_ptr<Word> Minus;
-	static std::shared_ptr<Word> True;
-	static std::shared_ptr<Word> False;
-	static std::shared_ptr<Word> Temp;
+	static const std::shared_ptr<Word> And;
+	static const std::shared_ptr<Word> Or;
+	static const std::shared_ptr<Word> Eq;
+	static const std::shared_ptr<Word> Ne;
+	static const std::shared_ptr<Word> Le;
+	static const std::shared_ptr<Word> Ge;
+	static const std::shared_ptr<Word> Minus;
+	static const std::shared_ptr<Word> True;
+	static const std::shared_ptr<Word> False;
+	static const std::shared_ptr<Word> Temp;
 };
 
-std::shared_ptr<Word> Word::And   = std::make_shared<Word>("&&", AND);
-std::shared_ptr<Word> Word::Or    = std::make_shared<Word>("||", OR);
-std::shared_ptr<Word> Word::Eq    = std::make_shared<Word>("==", EQ);
-std::shared_ptr<Word> Word::Ne    = std::make_shared<Word>("!=", NE);
-std::shared_ptr<Word> Word::Le    = std::make_shared<Word>("<=", LE);
-std::shared_ptr<Word> Word::Ge    = std::make_shared<Word>(">=", GE);
-std::shared_ptr<Word> Word::Minus = std::make_shared<Word>("minus", MINUS);
-std::shared_ptr<Word> Word::True  = std::make_shared<Word>("true", TRUE);
-std::shared_ptr<Word> Word::False = std::make_shared<Word>("false", FALSE);
-std::shared_ptr<Word> Word::Temp  = std::make_shared<Word>("t", TEMP);
+const std::shared_ptr<Word> Word::And   = std::make_shared<Word>("&&", AND);
+const std::shared_ptr<Word> Word::Or    = std::make_shared<Word>("||", OR);
+const std::shared_ptr<Word> Word::Eq    = std::make_shared<Word>("==", EQ);
+const std::shared_ptr<Word> Word::Ne    = std::make_shared<Word>("!=", NE);
+const std::shared_ptr<Word> Word::Le    = std::make_shared<Word>("<=", LE);
+const std::shared_ptr<Word> Word::Ge    = std::make_shared<Word>(">=", GE);
+const std::shared_ptr<Word> Word::Minus = std::make_shared<Word>("minus", MINUS);
+const std::shared_ptr<Word> Word::True  = std::make_shared<Word>("true", TRUE);
+const std::shared_ptr<Word> Word::False = std::make_shared<Word>("false", FALSE);
+const std::shared_ptr<Word> Word::Temp  = std::make_shared<Word>("t", TEMP);
 
 /*
 	Floating point number token
@@ -88,7 +88,7 @@ public:
 
 class Lexer {
 public:
-	Lexer(const char* filename) : peek(' ') {
+	Lexer(const char* filename) : line(0), tokens(0), peek(' ') {
 		is.open(filename);
 
 		if (!is.is_open()) {
@@ -97,7 +97,8 @@ public:
 		}
 	}
 
-	static int line;
+	int line;
+	size_t tokens; // Number of tokens scanned
 	char peek;
 	std::map<std::string, std::shared_ptr<Word> > words;
 	std::ifstream is;
@@ -121,6 +122,7 @@ public:
 
 	// Recognize next token
 	std::shared_ptr<Token> scan() {
+		tokens++;
 
 		// Skip whitespace characters
 		for (;; readch()) {
@@ -205,6 +207,4 @@ private:
 		ss >> d;
 		return d;
 	}
-};
-
-int Lexer::line = 0;
\ No newline at end of file
+};
\ No newline at end of file
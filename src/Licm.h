@@ -0,0 +1,114 @@
+#pragma once
+#include "Analyses.h"
+#include "SSA.h"
+
+/*
+	Loop-invariant code motion on the SSA form. A computation whose
+	operands are all assigned outside a loop is moved to a preheader, a
+	new block entered from outside the loop just ahead of its header, of
+	the outermost loop where it stays invariant. Copies are left to copy
+	propagation. Arithmetic is moved even if the loop body may not run,
+	loads and divisions by a variable only from blocks running on every
+	way out of the loop, and loads only from arrays the loop neither
+	stores into nor checks the offsets of
+*/
+class Licm {
+public:
+	// Returns the number of instructions moved
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		SSA ssa(code, analyses);
+		const CFG& cfg = ssa.cfg;
+		const Loops& nest = analyses.loops();
+		std::vector<Quad>& quads = code.quads;
+		size_t n = code.operands.size();
+		int count = (int)nest.loops.size();
+
+		// The preheader falls into the header, so the block laid out before
+		// the header must not be one of the loop that falls into it
+		std::vector<char> movable(count, 1);
+		for (int l = 0; l < count; l++) {
+			int h = nest.loops[l].header;
+			if (h == 0) continue;
+			const Quad& last = quads[cfg.blocks[h - 1].end - 1];
+			if (last.op != Opcode::Goto && nest.contains(l, h - 1)) movable[l] = 0;
+		}
+
+		// Arrays stored into in each loop, or checked there, a load moved
+		// ahead of its check could reach past the array
+		std::vector<std::vector<int> > stores(count);
+		for (int l = 0; l < count; l++) {
+			for (int b : nest.loops[l].blocks) {
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					if (quads[i].op == Opcode::Store) stores[l].push_back(quads[i].dest);
+					if (quads[i].op == Opcode::Check) stores[l].push_back(quads[i].src1);
+				}
+			}
+		}
+		auto stored = [&](int l, int array) {
+			return std::find(stores[l].begin(), stores[l].end(), array) != stores[l].end();
+		};
+
+		// Loop where each name is assigned, -1 outside loops
+		std::vector<int> at(n, -1);
+		for (int b : ssa.dom.order) {
+			for (auto& phi : ssa.phis[b]) at[phi.dest] = nest.innermost[b];
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (quads[i].def() != Quad::None) at[quads[i].def()] = nest.innermost[b];
+			}
+		}
+
+		// In dominator order, so the operands of an instruction have found
+		// their place before it
+		std::vector<std::vector<Quad> > hoisted(count);
+		std::vector<char> removed(quads.size(), 0);
+		int moved = 0, u[3];
+		for (int b : ssa.dom.order) {
+			if (nest.innermost[b] < 0) continue;
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				const Quad& q = quads[i];
+				int d = q.def();
+				if (d == Quad::None || q.op == Opcode::Copy) continue; // A copy only renames
+				int c;
+				bool speculate = q.op != Opcode::Load && (q.op != Opcode::Div || (code.integer(q.src2, c) && c != 0));
+				int k = q.uses(u);
+				int target = -1;
+				for (int l = nest.innermost[b]; l >= 0 && movable[l]; l = nest.loops[l].parent) {
+					bool invariant = true;
+					for (int j = 0; j < k && invariant; j++) invariant = !nest.within(at[u[j]], l);
+					if (invariant && q.op == Opcode::Load) invariant = !stored(l, q.src1);
+					if (invariant && !speculate) {
+						for (int e : nest.loops[l].exits) invariant = invariant && ssa.dom.dominates(b, e);
+					}
+					if (!invariant) break;
+					target = l;
+				}
+				if (target < 0) continue;
+				hoisted[target].push_back(q);
+				at[d] = nest.loops[target].parent;
+				removed[i] = 1;
+				moved++;
+			}
+		}
+
+		// Each preheader takes a new label, the jumps into the header from
+		// outside the loop go to it
+		int label = 0;
+		for (const Quad& q : quads) label = std::max(label, q.label);
+		std::vector<std::vector<Quad> > before(cfg.blocks.size());
+		for (int l = 0; l < count; l++) {
+			if (hoisted[l].empty()) continue;
+			int h = nest.loops[l].header;
+			Quad q(Opcode::Label);
+			q.label = ++label;
+			before[h].push_back(q);
+			before[h].insert(before[h].end(), hoisted[l].begin(), hoisted[l].end());
+			for (int p : cfg.predecessors(h)) {
+				Quad& last = quads[cfg.blocks[p].end - 1];
+				if (!nest.contains(l, p) && last.jump() && cfg.labels[last.label] == h) last.label = q.label;
+			}
+		}
+		ssa.leave(removed, before);
+		return moved;
+	}
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include "CFG.h"
+
+/*
+	Set of small integers in machine words
+*/
+class Bits {
+public:
+	Bits(size_t n = 0, bool full = false) : words((n + 63) / 64, full ? ~uint64_t(0) : 0) {}
+
+	bool test(int i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+	void set(int i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+	void reset(int i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+
+	// Adds the elements of b, returns true if the set grew
+	bool merge(const Bits& b) {
+		bool changed = false;
+		for (size_t i = 0; i < words.size(); i++) {
+			uint64_t w = words[i] | b.words[i];
+			changed |= w != words[i];
+			words[i] = w;
+		}
+		return changed;
+	}
+
+	void subtract(const Bits& b) {
+		for (size_t i = 0; i < words.size(); i++) words[i] &= ~b.words[i];
+	}
+
+	void intersect(const Bits& b) {
+		for (size_t i = 0; i < words.size(); i++) words[i] &= b.words[i];
+	}
+
+	bool operator==(const Bits& b) const { return words == b.words; }
+
+private:
+	std::vector<uint64_t> words;
+};
+
+/*
+	Live variables and temporaries at the borders of the basic blocks.
+	Only the operands read in some block before they are assigned there
+	can be live across blocks, the sets are kept over these names only.
+	The variables hold the results of the program, they are all live at
+	the end of the code
+*/
+class Liveness {
+public:
+	std::vector<int> index; // Index of each operand among the names, or -1
+	std::vector<int> names; // Operands live across blocks
+	std::vector<Bits> in, out;
+
+	Liveness(const Code& code, const CFG& cfg) {
+		const std::vector<Quad>& quads = code.quads;
+		int count = (int)cfg.blocks.size();
+		int u[3];
+
+		// Upward exposed uses of each block are the names
+		index.assign(code.operands.size(), -1);
+		std::vector<int> defined(code.operands.size(), -1);
+		for (int b = 0; b < count; b++) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int n = quads[i].uses(u);
+				for (int k = 0; k < n; k++) {
+					if (defined[u[k]] != b && index[u[k]] < 0 && code.operands[u[k]].kind != Operand::Const) {
+						index[u[k]] = (int)names.size();
+						names.push_back(u[k]);
+					}
+				}
+				if (quads[i].def() != Quad::None) defined[quads[i].def()] = b;
+			}
+		}
+		std::vector<int> results;
+		for (size_t x = 0; x < code.operands.size(); x++) {
+			const Operand& o = code.operands[x];
+			if (o.kind != Operand::Var || o.version > 0 || dynamic_cast<Array*>(o.type.get()) != nullptr) continue;
+			if (index[x] < 0) {
+				index[x] = (int)names.size();
+				names.push_back((int)x);
+			}
+			results.push_back(index[x]);
+		}
+
+		// Uses before assignment and assignments of each block
+		std::vector<Bits> use(count, Bits(names.size())), def(count, Bits(names.size()));
+		for (int b = 0; b < count; b++) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int n = quads[i].uses(u);
+				for (int k = 0; k < n; k++) {
+					int x = index[u[k]];
+					if (x >= 0 && !def[b].test(x)) use[b].set(x);
+				}
+				int d = quads[i].def();
+				if (d != Quad::None && index[d] >= 0) def[b].set(index[d]);
+			}
+		}
+
+		// Iterate to the fixed point, backwards as liveness flows
+		in.assign(count, Bits(names.size()));
+		out.assign(count, Bits(names.size()));
+		for (int x : results) {
+			if (count > 0) out[count - 1].set(x);
+		}
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int b = count - 1; b >= 0; b--) {
+				for (int s : cfg.successors(b)) out[b].merge(in[s]);
+				Bits x = out[b];
+				x.subtract(def[b]);
+				x.merge(use[b]);
+				if (!(x == in[b])) {
+					in[b] = x;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	bool liveIn(int b, int operand) const { return index[operand] >= 0 && in[b].test(index[operand]); }
+	bool liveOut(int b, int operand) const { return index[operand] >= 0 && out[b].test(index[operand]); }
+};
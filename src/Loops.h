@@ -0,0 +1,77 @@
+#pragma once
+#include "Dominators.h"
+
+/*
+	Natural loops of a control-flow graph. An edge to a block that
+	dominates its source is a back edge, the loop of a header is the
+	header with the blocks reaching a back edge to it without passing
+	through it. Loops are nested or disjoint
+*/
+class Loops {
+public:
+	struct Loop {
+		int header;
+		int parent; // Innermost enclosing loop, or -1
+		std::vector<int> blocks; // Header first
+		std::vector<int> latches; // Sources of the back edges
+		std::vector<int> exits; // Blocks of the loop with a successor outside
+	};
+
+	std::vector<Loop> loops; // Enclosing loops before the loops they contain
+	std::vector<int> innermost; // Innermost loop of each block, or -1
+
+	Loops(const CFG& cfg, const Dominators& dom) {
+		int count = (int)cfg.blocks.size();
+		std::vector<int> of(count, -1);
+		for (int b : dom.order) {
+			for (int h : cfg.successors(b)) {
+				if (!dom.dominates(h, b)) continue;
+				if (of[h] < 0) { of[h] = (int)loops.size(); loops.push_back({ h, -1, {}, {}, {} }); }
+				loops[of[h]].latches.push_back(b);
+			}
+		}
+
+		// Walk back from the latches, the header stops the walk
+		std::vector<int> mark(count, -1), work;
+		for (int l = 0; l < (int)loops.size(); l++) {
+			Loop& loop = loops[l];
+			mark[loop.header] = l;
+			loop.blocks.push_back(loop.header);
+			for (int b : loop.latches) {
+				if (mark[b] != l) { mark[b] = l; loop.blocks.push_back(b); work.push_back(b); }
+			}
+			while (!work.empty()) {
+				int b = work.back(); work.pop_back();
+				for (int p : cfg.predecessors(b)) {
+					if (mark[p] != l && dom.reachable(p)) { mark[p] = l; loop.blocks.push_back(p); work.push_back(p); }
+				}
+			}
+		}
+
+		// Larger loops first, a smaller loop sharing a block is nested in
+		// the innermost loop assigned to its header so far
+		std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() > b.blocks.size(); });
+		innermost.assign(count, -1);
+		for (int l = 0; l < (int)loops.size(); l++) {
+			loops[l].parent = innermost[loops[l].header];
+			for (int b : loops[l].blocks) innermost[b] = l;
+		}
+		for (int l = 0; l < (int)loops.size(); l++) {
+			for (int b : loops[l].blocks) {
+				for (int s : cfg.successors(b)) {
+					if (!contains(l, s)) { loops[l].exits.push_back(b); break; }
+				}
+			}
+		}
+	}
+
+	// True if loop l is inner, or the same, as loop outer
+	bool within(int l, int outer) const {
+		for (; l >= 0; l = loops[l].parent) {
+			if (l == outer) return true;
+		}
+		return false;
+	}
+
+	bool contains(int l, int b) const { return within(innermost[b], l); }
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include "Analyses.h"
+#include <map>
+#include <tuple>
+
+/*
+	Local value numbering: in each basic block an expression already
+	computed is replaced by a copy of the operand holding its value,
+	integer constants are folded and propagated to the uses, and the
+	identities x + 0, x - 0, x * 1, x / 1 and x * 0 are simplified.
+	Temporaries left unused in their block are removed
+*/
+class Numbering {
+public:
+	// Returns the number of instructions simplified or removed
+	static int run(Code& code, Analyses& analyses) {
+		const CFG& cfg = analyses.cfg();
+		const Liveness& live = analyses.live();
+		Numbering n(code);
+		int changed = 0;
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) changed += n.block(cfg.blocks[b], live, b);
+
+		int j = 0;
+		for (size_t i = 0; i < code.quads.size(); i++) {
+			if (!n.removed[i]) code.quads[j++] = code.quads[i];
+		}
+		if (j < (int)code.quads.size()) {
+			code.quads.erase(code.quads.begin() + j, code.quads.end());
+			analyses.invalidate(Analyses::Graph);
+		}
+		else if (changed > 0) analyses.invalidate(Analyses::Live); // The blocks stay, the operands change
+		return changed;
+	}
+
+	// Result of an integer operation, false if it overflows or divides by zero
+	static bool fold(Opcode op, int a, int b, int& result) {
+		long long r;
+		switch (op) {
+		case Opcode::Add: r = (long long)a + b; break;
+		case Opcode::Sub: r = (long long)a - b; break;
+		case Opcode::Mul: r = (long long)a * b; break;
+		case Opcode::Div:
+			if (b == 0) return false;
+			r = (long long)a / b;
+			break;
+		case Opcode::Neg: r = -(long long)a; break;
+		default: return false;
+		}
+		if (r < INT32_MIN || r > INT32_MAX) return false;
+		result = (int)r;
+		return true;
+	}
+
+private:
+	Code& code;
+	std::vector<char> removed;
+
+	// Value numbers of the operands in the current block, stamped with the
+	// block so that the vector needs no clearing
+	std::vector<int> number, stamp;
+	std::vector<int> home; // Operand holding each value
+	std::vector<int> value; // Integer constant of each value
+	std::vector<char> known;
+	std::map<std::tuple<Opcode, int, int>, int> table;
+	std::map<int, int> constants; // Value of each integer constant
+
+	Numbering(Code& c) : code(c), removed(c.quads.size(), 0), number(c.operands.size()), stamp(c.operands.size(), -1) {}
+
+	int fresh(int operand) {
+		if (operand >= (int)number.size()) { number.resize(operand + 1); stamp.resize(operand + 1, -1); }
+		int v = (int)home.size();
+		home.push_back(operand);
+		value.push_back(0);
+		known.push_back(0);
+		return v;
+	}
+
+	int constant(int c) {
+		auto result = constants.find(c);
+		if (result != constants.end()) return result->second;
+		int v = fresh(code.constant(c));
+		value[v] = c; known[v] = 1;
+		constants.emplace(c, v);
+		return v;
+	}
+
+	int vn(int x, int b) {
+		if (x >= (int)number.size()) { number.resize(x + 1); stamp.resize(x + 1, -1); }
+		if (stamp[x] == b) return number[x];
+		int c;
+		stamp[x] = b;
+		number[x] = code.integer(x, c) ? constant(c) : fresh(x);
+		return number[x];
+	}
+
+	void assign(int x, int v, int b) {
+		vn(x, b);
+		number[x] = v;
+		if (number[home[v]] != v || stamp[home[v]] != b) home[v] = x;
+	}
+
+	// Operand holding value v at this point of the block, or None
+	int holder(int v, int b) {
+		int h = home[v];
+		return stamp[h] == b && number[h] == v ? h : Quad::None;
+	}
+
+	bool temp(int x) { return x != Quad::None && code.operands[x].kind == Operand::Temp; }
+	bool integral(int x) { return code.operands[x].type == Type::Int || code.operands[x].type == Type::Char; }
+
+	int block(const CFG::Block& block, const Liveness& live, int b) {
+		std::vector<Quad>& quads = code.quads;
+		table.clear(); constants.clear();
+		home.clear(); value.clear(); known.clear();
+		std::vector<char> simplified(block.end - block.begin, 0); // Counted once, even if removed later
+		int* p[3];
+
+		for (int i = block.begin; i < block.end; i++) {
+			Quad& q = quads[i];
+
+			// Operands take the constant or the first holder of their value,
+			// except the arrays of loads and stores
+			int n = q.uses(p);
+			for (int k = 0; k < n; k++) {
+				bool load = q.op == Opcode::Load || q.op == Opcode::VLoad || q.op == Opcode::Check, store = q.op == Opcode::Store || q.op == Opcode::VStore;
+				if ((load && p[k] == &q.src1) || (store && p[k] == &q.dest)) continue;
+				int v = vn(*p[k], b);
+				if (known[v]) *p[k] = code.constant(value[v]);
+				else if (temp(*p[k]) && holder(v, b) != Quad::None) *p[k] = holder(v, b);
+			}
+
+			int d = q.def();
+			if (q.op == Opcode::Store || q.op == Opcode::VStore) {
+				assign(q.dest, fresh(q.dest), b); // Loads from the array are stale
+				continue;
+			}
+			if (d == Quad::None) continue;
+
+			int v1 = q.src1 != Quad::None ? vn(q.src1, b) : -1;
+			int v2 = q.src2 != Quad::None ? vn(q.src2, b) : -1;
+			int result = -1;
+			int c;
+			switch (q.op) {
+			case Opcode::Copy:
+				result = v1;
+				break;
+			case Opcode::Neg:
+				if (known[v1] && fold(q.op, value[v1], 0, c)) result = constant(c);
+				break;
+			case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div:
+				if (known[v1] && known[v2] && fold(q.op, value[v1], value[v2], c)) result = constant(c);
+				else result = identity(q.op, v1, v2, integral(d));
+				break;
+			default:
+				break;
+			}
+
+			if (result < 0) {
+				// Look the expression up, the operands of + and * commute
+				if ((q.op == Opcode::Add || q.op == Opcode::Mul) && v1 > v2) std::swap(v1, v2);
+				auto key = std::make_tuple(q.op, v1, v2);
+				auto found = table.find(key);
+				if (found != table.end() && holder(found->second, b) != Quad::None) {
+					result = found->second;
+					simplified[i - block.begin] = 1;
+				}
+				else {
+					result = fresh(d);
+					table[key] = result;
+					assign(d, result, b);
+					continue;
+				}
+			}
+			else if (q.op != Opcode::Copy) simplified[i - block.begin] = 1;
+
+			// The value exists already: copy it, or drop the instruction if
+			// the destination holds it
+			if (vn(d, b) == result) {
+				removed[i] = 1;
+				continue;
+			}
+			int h = known[result] ? code.constant(value[result]) : holder(result, b);
+			if (h == Quad::None && result == v1) h = q.src1;
+			else if (h == Quad::None && result == v2) h = q.src2;
+			if (h != Quad::None && (q.op != Opcode::Copy || h != q.src1)) q = Quad(Opcode::Copy, d, h);
+			assign(d, result, b);
+		}
+
+		// Remove the temporaries no longer used in the block
+		std::vector<char> used;
+		for (int i = block.end - 1; i >= block.begin; i--) {
+			if (removed[i]) continue;
+			Quad& q = quads[i];
+			int d = q.def();
+			if (temp(d)) {
+				if (d >= (int)used.size()) used.resize(d + 1, 0);
+				if (!used[d] && !live.liveOut(b, d)) {
+					removed[i] = 1;
+					continue;
+				}
+				used[d] = 0;
+			}
+			int u[3];
+			int n = q.uses(u);
+			for (int k = 0; k < n; k++) {
+				if (u[k] >= (int)used.size()) used.resize(u[k] + 1, 0);
+				used[u[k]] = 1;
+			}
+		}
+		int changed = 0;
+		for (int i = block.begin; i < block.end; i++) changed += removed[i] || simplified[i - block.begin];
+		return changed;
+	}
+
+	// Value of an operation with a neutral or absorbing operand, or -1
+	int identity(Opcode op, int v1, int v2, bool integer) {
+		auto is = [&](int v, int c) { return known[v] && value[v] == c; };
+		switch (op) {
+		case Opcode::Add:
+			if (is(v2, 0)) return v1;
+			if (is(v1, 0)) return v2;
+			break;
+		case Opcode::Sub:
+			if (is(v2, 0)) return v1;
+			break;
+		case Opcode::Mul:
+			if (is(v2, 1)) return v1;
+			if (is(v1, 1)) return v2;
+			if (integer && (is(v1, 0) || is(v2, 0))) return constant(0);
+			break;
+		case Opcode::Div:
+			if (is(v2, 1)) return v1;
+			break;
+		default:
+			break;
+		}
+		return -1;
+	}
+};
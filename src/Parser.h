@@ -2,6 +2,7 @@
 #include "Lexer.h"
 #include "Symbols.h"
 #include "Inter.h"
+#include <tuple>
 
 /*
 	Symbol table
@@ -24,11 +25,39 @@ private:
 	std::map<std::shared_ptr<Token>, std::shared_ptr<Id> > table;
 };
 
+/*
+	Table of expression nodes: an expression is built only once and
+	then shared, which turns the syntax tree into a DAG
+*/
+class Dag {
+public:
+	Dag(const int& l) : line(l) {}
+
+	// Operator tag, lexeme, operands and type identify a node
+	typedef std::tuple<int, std::string, Node*, Node*, Type*> Key;
+
+	template <typename T, typename... Args>
+	std::shared_ptr<T> get(const Key& k, Args&&... args) {
+		auto result = nodes.find(k);
+		if (result != nodes.end()) return std::static_pointer_cast<T>(result->second);
+		std::shared_ptr<T> x = std::make_shared<T>(std::forward<Args>(args)...);
+		x->lexline = line;
+		nodes.emplace(k, x);
+		return x;
+	}
+private:
+	const int& line; // Current line of the lexer
+	std::map<Key, std::shared_ptr<Expr> > nodes;
+};
+
 class Parser {
 public:
 	std::shared_ptr<Env> top; // Current or top symbol table
+	Dag dag; // Shared expression nodes
+	std::shared_ptr<Stmt> enclosing; // Enclosing loop for break
 	int used;
-	Parser(std::shared_ptr<Lexer> lexer) : lex(lexer), used(0) { 
+	static const int Nesting = 1000; // Deepest expression accepted
+	Parser(std::shared_ptr<Lexer> lexer) : dag(lexer->line), enclosing(Stmt::Null), used(0), lex(lexer) { 
 		lexer->reserve(std::make_shared<Word>("if", IF));
 		lexer->reserve(std::make_shared<Word>("else", ELSE));
 		lexer->reserve(std::make_shared<Word>("while", WHILE));
@@ -55,19 +84,34 @@ public:
 		else error("syntax error");
 	}
 
+	// Expressions nest by recursion, a parenthesis, index or unary
+	// operator deeper than Nesting is an error rather than a stack overflow
+	void nest() {
+		if (++nesting > Nesting) error("expression nested too deeply");
+	}
+
+	// Creates a node of the AST at the current line
+	template <typename T, typename... Args>
+	std::shared_ptr<T> make(Args&&... args) {
+		std::shared_ptr<T> x = std::make_shared<T>(std::forward<Args>(args)...);
+		x->lexline = lex->line;
+		return x;
+	}
+
 	// program -> block
 	std::shared_ptr<Stmt> program() {
 		// It starts to produce AST
-		std::shared_ptr<Stmt> s = block();
-	
-		// It generates the beginning of the program
-		int begin = s->newlabel();
-		int after = s->newlabel();
-		s->emitlabel(begin);
-		s->gen(begin, after);
-		s->emitlabel(after);
+		return block();
+	}
 
-		return s;
+	// Generates the three-address code of the program
+	void gen(Context& ctx, std::shared_ptr<Stmt> s) {
+		// It generates the beginning of the program
+		int begin = ctx.newlabel();
+		int after = ctx.newlabel();
+		ctx.emitlabel(begin);
+		s->gen(ctx, begin, after);
+		ctx.emitlabel(after);
 	}
 
 	// block -> decls stmts
@@ -84,7 +128,7 @@ public:
 			// D -> Type Id
 			std::shared_ptr<Type> p = type(); std::shared_ptr<Token> tok = look;
 			match(ID); match(';');
-			std::shared_ptr<Id> id = std::make_shared<Id>(std::dynamic_pointer_cast<Word>(tok), p, used);
+			std::shared_ptr<Id> id = make<Id>(std::dynamic_pointer_cast<Word>(tok), p, used);
 			top->put(tok, id);
 			used += p->width;
 		}
@@ -110,7 +154,7 @@ public:
 		}
 		else {
 			auto s = stmt(); auto ss = stmts();
-			return std::make_shared<Seq>(s, ss);
+			return make<Seq>(s, ss);
 		}
 	}
 
@@ -128,42 +172,42 @@ public:
 			x = boolean(); match(')');
 			s1 = stmt();
 			if (look->tag != ELSE) {
-				return std::make_shared<If>(x, s1);
+				return make<If>(x, s1);
 			}
 			match(ELSE);
 			s2 = stmt();
-			return std::make_shared<Else>(x, s1, s2);
+			return make<Else>(x, s1, s2);
 			break;
 		case WHILE:
 			{
-				std::shared_ptr<While> w = std::make_shared<While>();
-				savedStmt = Stmt::Enclosing;
-				Stmt::Enclosing = w;
+				std::shared_ptr<While> w = make<While>();
+				savedStmt = enclosing;
+				enclosing = w;
 				match(WHILE); match('(');
 				x = boolean(); match(')');
 				s1 = stmt();
 				w->Init(x, s1);
-				Stmt::Enclosing = savedStmt;
+				enclosing = savedStmt;
 				return w;
 			}
 			break;
 		case DO:
 			{
-				std::shared_ptr<Do> d = std::make_shared<Do>();
-				savedStmt = Stmt::Enclosing;
-				Stmt::Enclosing = d;
+				std::shared_ptr<Do> d = make<Do>();
+				savedStmt = enclosing;
+				enclosing = d;
 				match(DO);
 				s1 = stmt();
 				match(WHILE); match('(');
 				x = boolean(); match(')');
 				d->Init(s1, x);
-				Stmt::Enclosing = savedStmt;
+				enclosing = savedStmt;
 				return d;
 			}
 			break;
 		case BREAK:
 			match(BREAK); match(';');
-			return std::make_shared<Break>();
+			return make<Break>(enclosing);
 			break;
 		case '{':
 			return block();
@@ -180,22 +224,25 @@ public:
 		std::shared_ptr<Id> id = top->get(tok);
 		if (id == nullptr) error(tok->toString() + " undeclared");
 		if (look->tag == '=') {
-			move(); stmt = std::make_shared<Set>(id, boolean());
+			move(); stmt = make<Set>(id, boolean());
 		}
 		else {
 			std::shared_ptr<Access> x = offset(id);
-			match('='); stmt = std::make_shared<SetElem>(x, boolean());
+			match('='); stmt = make<SetElem>(x, boolean());
 		}
 		match(';');
 		return stmt;
 	}
 
 	std::shared_ptr<Expr> boolean() {
+		nest();
 		std::shared_ptr<Expr> x = join();
 		while (look->tag == OR) {
 			std::shared_ptr<Token> tok = look; move();
-			x = std::make_shared<Or>(tok, x, join());
+			std::shared_ptr<Expr> y = join();
+			x = dag.get<Or>({ OR, "", x.get(), y.get(), nullptr }, tok, x, y);
 		}
+		nesting--;
 		return x;
 	}
 
@@ -203,7 +250,8 @@ public:
 		std::shared_ptr<Expr> x = equality();
 		while (look->tag == AND) {
 			std::shared_ptr<Token> tok = look; move();
-			x = std::make_shared<And>(tok, x, equality());
+			std::shared_ptr<Expr> y = equality();
+			x = dag.get<And>({ AND, "", x.get(), y.get(), nullptr }, tok, x, y);
 		}
 		return x;
 	}
@@ -212,7 +260,8 @@ public:
 		std::shared_ptr<Expr> x = rel();
 		while (look->tag == EQ) {
 			std::shared_ptr<Token> tok = look; move();
-			x = std::make_shared<Rel>(tok, x, rel());
+			std::shared_ptr<Expr> y = rel();
+			x = dag.get<Rel>({ tok->tag, "", x.get(), y.get(), nullptr }, tok, x, y);
 		}
 		return x;
 	}
@@ -226,7 +275,8 @@ public:
 		case '>':
 			{
 				std::shared_ptr<Token> tok = look; move();
-				x = std::make_shared<Rel>(tok, x, expr());
+				std::shared_ptr<Expr> y = expr();
+				x = dag.get<Rel>({ tok->tag, "", x.get(), y.get(), nullptr }, tok, x, y);
 			}
 		default:
 			return x;
@@ -238,7 +288,8 @@ public:
 		std::shared_ptr<Expr> x = term();
 		while (look->tag == '+' || look->tag == '-') {
 			std::shared_ptr<Token> tok = look; move();
-			x = std::make_shared<Arith>(tok, x, term());
+			std::shared_ptr<Expr> y = term();
+			x = dag.get<Arith>({ tok->tag, "", x.get(), y.get(), nullptr }, tok, x, y);
 		}
 		return x;
 	}
@@ -247,19 +298,20 @@ public:
 		std::shared_ptr<Expr> x = unary();
 		while (look->tag == '*' || look->tag == '/') {
 			std::shared_ptr<Token> tok = look; move();
-			x = std::make_shared<Arith>(tok, x, unary());
+			std::shared_ptr<Expr> y = unary();
+			x = dag.get<Arith>({ tok->tag, "", x.get(), y.get(), nullptr }, tok, x, y);
 		}
 		return x;
 	}
 
 	std::shared_ptr<Expr> unary() {
 		if (look->tag == '-') {
-			move();
-			return std::make_shared<Unary>(Word::Minus, unary());
+			nest(); move(); std::shared_ptr<Expr> x = unary(); nesting--;
+			return dag.get<Unary>({ MINUS, "", x.get(), nullptr, nullptr }, Word::Minus, x);
 		}
 		else if (look->tag == '!') {
-			std::shared_ptr<Token> tok = look; move();
-			return std::make_shared<Not>(tok, unary());
+			nest(); std::shared_ptr<Token> tok = look; move(); std::shared_ptr<Expr> x = unary(); nesting--;
+			return dag.get<Not>({ '!', "", x.get(), nullptr, nullptr }, tok, x);
 		}
 		else return factor();
 	}
@@ -272,11 +324,11 @@ public:
 			return x;
 			break;
 		case NUM:
-			x = std::make_shared<Constant>(look, Type::Int);
+			x = dag.get<Constant>({ NUM, look->toString(), nullptr, nullptr, Type::Int.get() }, look, Type::Int);
 			move(); return x;
 			break;
 		case REAL:
-			x = std::make_shared<Constant>(look, Type::Float);
+			x = dag.get<Constant>({ REAL, look->toString(), nullptr, nullptr, Type::Float.get() }, look, Type::Float);
 			move(); return x;
 			break;
 		case TRUE:
@@ -313,20 +365,30 @@ public:
 		std::shared_ptr<Type> type = a->type;
 		match('['); i = boolean(); match(']');
 		type = (std::dynamic_pointer_cast<Array>(type))->of;
-		w = std::make_shared<Constant>(type->width);
-		t1 = std::make_shared<Arith>(std::make_shared<Token>('*'), i, w);
+		w = constant(type->width);
+		t1 = arith('*', i, w);
 		loc = t1;
 		while (look->tag == '[') {
 			match('['); i = boolean(); match(']');
 			type = (std::dynamic_pointer_cast<Array>(type))->of;
-			w = std::make_shared<Constant>(type->width);
-			t1 = std::make_shared<Arith>(std::make_shared<Token>('*'), i, w);
-			t2 = std::make_shared<Arith>(std::make_shared<Token>('+'), loc, t1);
+			w = constant(type->width);
+			t1 = arith('*', i, w);
+			t2 = arith('+', loc, t1);
 			loc = t2;
 		}
-		return std::make_shared<Access>(a, loc, type);
+		return dag.get<Access>({ INDEX, "", a.get(), loc.get(), type.get() }, a, loc, type);
+	}
+
+	std::shared_ptr<Expr> constant(int i) {
+		std::stringstream ss; ss << i;
+		return dag.get<Constant>({ NUM, ss.str(), nullptr, nullptr, Type::Int.get() }, i);
+	}
+
+	std::shared_ptr<Expr> arith(int op, std::shared_ptr<Expr> x1, std::shared_ptr<Expr> x2) {
+		return dag.get<Arith>({ op, "", x1.get(), x2.get(), nullptr }, std::make_shared<Token>(op), x1, x2);
 	}
 private:
 	std::shared_ptr<Lexer> lex;
 	std::shared_ptr<Token> look;
-};
\ No newline at end of file
+	int nesting = 0; // Expressions entered and not yet left
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+#include "Bounds.h"
+#include "Copies.h"
+#include "Dead.h"
+#include "Induction.h"
+#include "Jumps.h"
+#include "Layout.h"
+#include "Licm.h"
+#include "Numbering.h"
+#include "Pre.h"
+#include "Rotation.h"
+#include "SCCP.h"
+#include "Temps.h"
+#include "Unroll.h"
+#include "Vectorize.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+
+/*
+	Pass manager. The passes run in a fixed order, each from the lowest
+	optimization level it belongs to: level 1 folds constants, removes
+	dead code, copies and jumps and numbers the values, level 2 adds the
+	loop passes, partial redundancy elimination and the block layout.
+	The analyses are shared by the passes, a pass changing the code
+	invalidates the ones it no longer holds for. Each pass is timed, with
+	the instructions before and after it and the analyses it computed
+*/
+class Passes {
+public:
+	static const int Levels = 2; // Highest optimization level
+
+	typedef std::map<std::string, size_t> Counters;
+
+	struct Pass {
+		std::string name;
+		int level; // Lowest level running the pass
+		std::function<void(Code&, Analyses&, Counters&)> run;
+	};
+
+	struct Timing {
+		std::string name;
+		double seconds;
+		size_t before, after; // Instructions
+		int built; // Analyses computed
+	};
+
+	std::vector<Timing> timings;
+
+	// The passes of the level, led by the bounds checks if asked for
+	Passes(int level, bool bounds, int factor = Unroll::Factor, int width = Vectorize::Width) : level(level) {
+		if (bounds) {
+			add("bounds", 0, [](Code& c, Analyses& a, Counters& n) {
+				int checks = 0;
+				n["accesses proven"] = Bounds::run(c, a, checks);
+				n["checks inserted"] = checks;
+			});
+		}
+		add("rotation", 2, [](Code& c, Analyses& a, Counters& n) { n["loops rotated"] = Rotation::run(c, a); });
+		add("sccp", 1, [](Code& c, Analyses& a, Counters& n) { n["constants folded"] = SCCP::run(c, a); });
+		add("dead code", 1, [](Code& c, Analyses& a, Counters& n) {
+			n["unreachable removed"] = Dead::unreachable(c, a);
+			n["dead removed"] = Dead::run(c, a);
+		});
+		add("licm", 2, [](Code& c, Analyses& a, Counters& n) { n["invariants hoisted"] = Licm::run(c, a); });
+		add("pre", 2, [](Code& c, Analyses& a, Counters& n) { n["redundancies replaced"] = Pre::run(c, a); });
+		add("induction", 2, [](Code& c, Analyses& a, Counters& n) { n["products reduced"] = Induction::run(c, a); });
+		add("copies", 1, [](Code& c, Analyses& a, Counters& n) { n["copies removed"] = Copies::run(c, a); });
+		add("jumps", 1, [](Code& c, Analyses& a, Counters& n) { n["jumps removed"] = Jumps::run(c, a); });
+		add("layout", 2, [](Code& c, Analyses& a, Counters& n) { n["jumps laid out"] = Layout::run(c, a); });
+		add("vectorize", 2, [width](Code& c, Analyses& a, Counters& n) { n["loops vectorized"] = Vectorize::run(c, a, width); });
+		add("unroll", 2, [factor](Code& c, Analyses& a, Counters& n) { n["loops unrolled"] = Unroll::run(c, a, factor); });
+		add("numbering", 1, [](Code& c, Analyses& a, Counters& n) { n["values reused"] = Numbering::run(c, a); });
+		add("temps", 1, [](Code& c, Analyses& a, Counters& n) { n["temporary slots"] = Temps::run(c, a); });
+	}
+
+	// Leaves out the pass of the name, to measure what it brings
+	void skip(const std::string& name) {
+		passes.erase(std::remove_if(passes.begin(), passes.end(), [&](const Pass& p) { return p.name == name; }), passes.end());
+	}
+
+	// Runs the passes on the code, done is called after each with its
+	// name and counters
+	void run(Code& code, std::function<void(const std::string&, const Counters&)> done = nullptr) {
+		Analyses analyses(code);
+		for (const Pass& pass : passes) {
+			Counters counters;
+			size_t before = code.quads.size();
+			int built = analyses.built;
+			auto start = std::chrono::steady_clock::now();
+			pass.run(code, analyses, counters);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			timings.push_back({ pass.name, seconds, before, code.quads.size(), analyses.built - built });
+			if (done) done(pass.name, counters);
+		}
+	}
+
+	void report(std::ostream& os) const {
+		os << std::left << std::setw(12) << "pass" << std::right << std::setw(12) << "time (ms)"
+			<< std::setw(14) << "instructions" << std::setw(10) << "delta" << std::setw(10) << "analyses" << std::endl;
+		double total = 0;
+		for (const Timing& t : timings) {
+			long long delta = (long long)t.after - (long long)t.before;
+			os << std::left << std::setw(12) << t.name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << t.seconds * 1000
+				<< std::setw(14) << t.after << std::setw(10) << (delta > 0 ? "+" : "") + std::to_string(delta) << std::setw(10) << t.built << std::endl;
+			total += t.seconds;
+		}
+		os << std::left << std::setw(12) << "total" << std::right << std::setw(12) << std::fixed << std::setprecision(3) << total * 1000 << std::endl;
+	}
+
+private:
+	int level;
+	std::vector<Pass> passes;
+
+	void add(std::string name, int lowest, std::function<void(Code&, Analyses&, Counters&)> run) {
+		if (lowest <= level) passes.push_back({ name, lowest, run });
+	}
+};
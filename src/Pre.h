@@ -0,0 +1,265 @@
+#pragma once
+#include "Analyses.h"
+#include <map>
+#include <tuple>
+
+/*
+	Partial redundancy elimination by lazy code motion. An expression
+	computed on some of the ways into a block and again in it, after an if
+	without an else, is computed into a temporary on the other ways, and
+	the computations it makes redundant copy the temporary. The places
+	follow from four problems of dataflow over the graph with its critical
+	edges split: the expression must be anticipated there, computed on
+	every way on from it, and not yet available, and it is postponed as
+	far as it can go and left where no computation would read the
+	temporary. No way computes an expression it did not compute before,
+	so divisions move as well. Loads stay, they may not pass their check.
+	An edge split gets its computations after the jump it falls from, or
+	in a new block after the code that the jump is sent to
+*/
+class Pre {
+public:
+	// Returns the number of computations replaced by a temporary
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		std::vector<Quad>& quads = code.quads;
+		const CFG& cfg = analyses.cfg();
+		const Dominators& dom = analyses.dom();
+		int count = (int)cfg.blocks.size();
+
+		// The expressions, by operation, operands and type, + and * with
+		// their operands in order
+		std::map<std::tuple<Opcode, int, int, Type*>, int> index;
+		std::vector<int> first; // Instruction computing each expression first
+		std::vector<int> which(quads.size(), -1); // Expression of each instruction
+		std::vector<std::vector<int> > users(code.operands.size()); // Expressions reading each name
+		for (int b : dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				const Quad& q = quads[i];
+				bool arithmetic = q.op == Opcode::Add || q.op == Opcode::Sub || q.op == Opcode::Mul || q.op == Opcode::Div || q.op == Opcode::Neg;
+				if (!arithmetic || code.lanes(q.dest) > 0) continue;
+				int a = q.src1, z = q.src2;
+				if ((q.op == Opcode::Add || q.op == Opcode::Mul) && a > z) std::swap(a, z);
+				auto key = std::make_tuple(q.op, a, z, code.operands[q.dest].type.get());
+				auto found = index.find(key);
+				if (found == index.end()) {
+					found = index.insert({ key, (int)first.size() }).first;
+					first.push_back(i);
+					for (int x : { a, z }) {
+						if (x != Quad::None && code.operands[x].kind != Operand::Const) users[x].push_back(found->second);
+					}
+				}
+				which[i] = found->second;
+			}
+		}
+		size_t n = first.size();
+		if (n == 0) return 0;
+
+		// The graph with a block on each critical edge, an edge leaving a
+		// conditional jump for a block with several ways into it
+		std::vector<std::vector<int> > succ(count), pred(count);
+		std::vector<std::pair<int, int> > split; // Edge of each block past the blocks of the code
+		std::vector<int> into(count, 0); // Reachable predecessors
+		for (int b : dom.order) {
+			for (int s : cfg.successors(b)) into[s]++;
+		}
+		for (int b : dom.order) {
+			std::vector<int> to;
+			for (int s : cfg.successors(b)) {
+				if (std::find(to.begin(), to.end(), s) == to.end()) to.push_back(s);
+			}
+			for (int s : to) {
+				if (to.size() < 2 || into[s] < 2) { succ[b].push_back(s); pred[s].push_back(b); continue; }
+				int e = (int)succ.size();
+				split.push_back({ b, s });
+				succ.push_back({ s });
+				pred.push_back({ b });
+				succ[b].push_back(e);
+				pred[s].push_back(e);
+			}
+		}
+		int nodes = (int)succ.size();
+		std::vector<char> live(nodes, 1);
+		for (int b = 0; b < count; b++) live[b] = dom.reachable(b);
+
+		// Expressions computed before their operands are assigned in each
+		// block, and the ones whose operands are assigned
+		std::vector<Bits> use(nodes, Bits(n)), kill(nodes, Bits(n));
+		std::vector<char> exposed(quads.size(), 0);
+		for (int b : dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int e = which[i], d = quads[i].def();
+				if (e >= 0 && !kill[b].test(e) && !use[b].test(e)) { use[b].set(e); exposed[i] = 1; }
+				if (d == Quad::None) continue;
+				for (int k : users[d]) kill[b].set(k);
+			}
+		}
+
+		// Anticipated on entry, computed on every way on before an operand
+		// changes
+		std::vector<Bits> antIn(nodes, Bits(n, true)), antOut(nodes, Bits(n));
+		solve(nodes, live, [&](int b) {
+			Bits out(n, !succ[b].empty());
+			for (int s : succ[b]) out.intersect(antIn[s]);
+			antOut[b] = out;
+			out.subtract(kill[b]);
+			out.merge(use[b]);
+			return update(antIn[b], out);
+		});
+
+		// Available on entry, anticipated or available on every way in
+		std::vector<Bits> avIn(nodes, Bits(n)), avOut(nodes, Bits(n, true));
+		solve(nodes, live, [&](int b) {
+			Bits in = meet(b, pred, live, avOut, n);
+			avIn[b] = in;
+			in.merge(antIn[b]);
+			in.subtract(kill[b]);
+			return update(avOut[b], in);
+		});
+
+		// Earliest where anticipated and not available, postponable on the
+		// ways on until computed
+		std::vector<Bits> earliest(nodes, Bits(n)), postIn(nodes, Bits(n)), postOut(nodes, Bits(n, true));
+		for (int b = 0; b < nodes; b++) {
+			earliest[b] = antIn[b];
+			earliest[b].subtract(avIn[b]);
+		}
+		solve(nodes, live, [&](int b) {
+			Bits in = meet(b, pred, live, postOut, n);
+			postIn[b] = in;
+			in.merge(earliest[b]);
+			in.subtract(use[b]);
+			return update(postOut[b], in);
+		});
+
+		// Latest where it can be postponed to and no further, on to a
+		// successor it cannot be postponed into or to a computation
+		std::vector<Bits> latest(nodes, Bits(n));
+		for (int b = 0; b < nodes; b++) {
+			if (!live[b]) continue;
+			Bits on(n, true);
+			for (int s : succ[b]) {
+				Bits into = earliest[s];
+				into.merge(postIn[s]);
+				on.intersect(into);
+			}
+			on.subtract(use[b]);
+			latest[b] = earliest[b];
+			latest[b].merge(postIn[b]);
+			latest[b].subtract(on);
+		}
+
+		// Used on exit, read by a computation on some way on before it is
+		// placed again
+		std::vector<Bits> usedIn(nodes, Bits(n)), usedOut(nodes, Bits(n));
+		solve(nodes, live, [&](int b) {
+			Bits out(n);
+			for (int s : succ[b]) out.merge(usedIn[s]);
+			usedOut[b] = out;
+			out.merge(use[b]);
+			out.subtract(latest[b]);
+			return update(usedIn[b], out);
+		});
+
+		// Temporaries of the expressions computed where latest and used
+		// after, the computations exposed elsewhere copy them
+		int number = 0;
+		for (const Operand& o : code.operands) {
+			if (o.kind == Operand::Temp) number = std::max(number, o.number);
+		}
+		std::vector<int> temps(n, Quad::None);
+		std::vector<std::vector<Quad> > placed(nodes);
+		for (int b = 0; b < nodes; b++) {
+			if (!live[b]) continue;
+			for (size_t e = 0; e < n; e++) {
+				if (!latest[b].test((int)e) || !usedOut[b].test((int)e)) continue;
+				Quad q = quads[first[e]];
+				if (temps[e] == Quad::None) temps[e] = code.temp(code.operands[q.dest].type, ++number);
+				q.dest = temps[e];
+				placed[b].push_back(q);
+			}
+		}
+		int replaced = 0;
+		for (int b : dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int e = which[i];
+				if (!exposed[i] || (latest[b].test(e) && !usedOut[b].test(e))) continue;
+				quads[i] = Quad(Opcode::Copy, quads[i].dest, temps[e]);
+				replaced++;
+			}
+		}
+		if (replaced == 0) return 0;
+
+		// The computations of a block follow its labels, the ones of a
+		// split edge follow the jump it falls from or go to a new block
+		int label = 0;
+		for (const Quad& q : quads) label = std::max(label, q.label);
+		std::vector<std::vector<Quad> > after(count);
+		std::vector<Quad> blocks;
+		for (size_t k = 0; k < split.size(); k++) {
+			const std::vector<Quad>& list = placed[count + k];
+			int p = split[k].first, s = split[k].second;
+			if (list.empty()) continue;
+			Quad& jump = quads[cfg.blocks[p].end - 1];
+			if (cfg.labels[jump.label] != s) {
+				after[p].insert(after[p].end(), list.begin(), list.end());
+				continue;
+			}
+			Quad start(Opcode::Label), back(Opcode::Goto);
+			start.label = ++label;
+			back.label = jump.label;
+			jump.label = start.label;
+			blocks.push_back(start);
+			blocks.insert(blocks.end(), list.begin(), list.end());
+			blocks.push_back(back);
+		}
+		std::vector<Quad> result;
+		for (int b = 0; b < count; b++) {
+			int i = cfg.blocks[b].begin;
+			for (; i < cfg.blocks[b].end && quads[i].op == Opcode::Label; i++) result.push_back(quads[i]);
+			result.insert(result.end(), placed[b].begin(), placed[b].end());
+			result.insert(result.end(), quads.begin() + i, quads.begin() + cfg.blocks[b].end);
+			result.insert(result.end(), after[b].begin(), after[b].end());
+		}
+		if (!blocks.empty()) {
+			// The code jumps over the new blocks to its end
+			Quad end(Opcode::Label), over(Opcode::Goto);
+			end.label = over.label = ++label;
+			if (result.back().op != Opcode::Goto) result.push_back(over);
+			result.insert(result.end(), blocks.begin(), blocks.end());
+			result.push_back(end);
+		}
+		quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return replaced;
+	}
+
+private:
+	// Visits the blocks until none changes
+	template <class F>
+	static void solve(int nodes, const std::vector<char>& live, F visit) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int b = 0; b < nodes; b++) {
+				if (live[b]) changed |= visit(b);
+			}
+		}
+	}
+
+	static bool update(Bits& set, const Bits& now) {
+		if (set == now) return false;
+		set = now;
+		return true;
+	}
+
+	// Intersection over the blocks reached before b, none on entry
+	static Bits meet(int b, const std::vector<std::vector<int> >& pred, const std::vector<char>& live, const std::vector<Bits>& out, size_t n) {
+		if (b == 0) return Bits(n);
+		Bits in(n, true);
+		for (int p : pred[b]) {
+			if (live[p]) in.intersect(out[p]);
+		}
+		return in;
+	}
+};
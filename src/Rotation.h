@@ -0,0 +1,79 @@
+#pragma once
+#include "Analyses.h"
+
+/*
+	Loop rotation. The header of a while loop tests whether to leave the
+	loop and the body jumps back to it, two jumps an iteration. The goto
+	back from each block of the loop is replaced by a copy of the header,
+	so that the test runs at the bottom and jumps straight to the body,
+	and the header is left guarding the entry as in a do loop. Headers of
+	more than a few instructions are not copied
+*/
+class Rotation {
+public:
+	static const int Limit = 8; // Instructions of a header copied at most
+
+	// Returns the number of loops rotated
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		std::vector<Quad>& quads = code.quads;
+		const CFG& cfg = analyses.cfg();
+		const Loops& nest = analyses.loops();
+		int count = (int)cfg.blocks.size(), label = 0;
+		for (const Quad& q : quads) label = std::max(label, q.label);
+
+		// The copies replacing the gotos back, and the blocks after a
+		// header that need a label to be jumped to
+		std::vector<std::vector<Quad> > copies(quads.size());
+		std::vector<int> fresh(count, -1);
+		int rotated = 0;
+		for (int l = 0; l < (int)nest.loops.size(); l++) {
+			const Loops::Loop& loop = nest.loops[l];
+			int h = loop.header;
+			const CFG::Block& k = cfg.blocks[h];
+			const Quad& test = quads[k.end - 1];
+			if ((test.op != Opcode::If && test.op != Opcode::IfFalse) || h + 1 >= count) continue;
+			if (nest.contains(l, cfg.labels[test.label]) == nest.contains(l, h + 1)) continue;
+			int begin = k.begin;
+			while (quads[begin].op == Opcode::Label) begin++;
+			if (k.end - begin > Limit) continue;
+
+			// The header falls into the block after it, the copies jump there
+			int next = -1;
+			const Quad& first = quads[cfg.blocks[h + 1].begin];
+			bool latched = false;
+			for (int p : loop.latches) {
+				int last = cfg.blocks[p].end - 1;
+				if (quads[last].op != Opcode::Goto || cfg.labels[quads[last].label] != h) continue;
+				if (next < 0) {
+					if (first.op == Opcode::Label) next = first.label;
+					else if (fresh[h + 1] >= 0) next = fresh[h + 1];
+					else next = fresh[h + 1] = ++label;
+				}
+				copies[last].assign(quads.begin() + begin, quads.begin() + k.end);
+				Quad back(Opcode::Goto);
+				back.label = next;
+				copies[last].push_back(back);
+				latched = true;
+			}
+			rotated += latched;
+		}
+		if (rotated == 0) return 0;
+
+		std::vector<Quad> result;
+		for (int b = 0; b < count; b++) {
+			if (fresh[b] >= 0) {
+				Quad q(Opcode::Label);
+				q.label = fresh[b];
+				result.push_back(q);
+			}
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (copies[i].empty()) result.push_back(quads[i]);
+				else result.insert(result.end(), copies[i].begin(), copies[i].end());
+			}
+		}
+		quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return rotated;
+	}
+};
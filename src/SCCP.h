@@ -0,0 +1,272 @@
+#pragma once
+#include "Dead.h"
+#include "Numbering.h"
+
+/*
+	Sparse conditional constant propagation (Wegman and Zadeck) on the SSA
+	form. A value is unknown until an executable assignment gives it, then
+	an integer or boolean constant, then varying. Only the edges that can
+	be taken under the values found so far are followed, so a constant
+	condition resolves its jump and the code it skips is removed.
+	Constants are substituted into the uses, array indices included
+*/
+class SCCP {
+public:
+	// Returns the number of instructions simplified or removed
+	static int run(Code& code, Analyses& analyses) {
+		if (code.quads.empty()) return 0;
+		SSA ssa(code, analyses);
+		SCCP s(code, ssa);
+		s.propagate();
+		int simplified = s.rewrite();
+
+		// The copies left in the blocks never reached go with them
+		Dead::unreachable(code, analyses);
+		return simplified;
+	}
+
+private:
+	enum State : uint8_t { Unknown, Constant, Varying };
+
+	Code& code;
+	SSA& ssa;
+	const CFG& cfg;
+	std::vector<State> state;
+	std::vector<int> value;
+	std::vector<char> reached; // Blocks with an executable edge into them
+	std::vector<char> taken; // Executable edges, indexed as the predecessors
+	std::vector<int> block; // Block of each instruction
+
+	// Instructions and phis reading each operand, a phi as block and index
+	std::vector<std::vector<int> > readers;
+	std::vector<std::vector<std::pair<int, int> > > phiReaders;
+
+	std::vector<std::pair<int, int> > edges; // Edges to follow
+	std::vector<int> changed; // Operands to propagate
+
+	SCCP(Code& c, SSA& s) : code(c), ssa(s), cfg(s.cfg) {
+		size_t n = code.operands.size();
+		state.assign(n, Unknown);
+		value.assign(n, 0);
+		readers.resize(n);
+		phiReaders.resize(n);
+		reached.assign(cfg.blocks.size(), 0);
+		taken.assign(cfg.preds.size(), 0);
+		block.assign(code.quads.size(), 0);
+
+		// Names never assigned hold their value on entry, the blocks not
+		// reached from the entry were left out of the renaming
+		std::vector<char> assigned(n, 0);
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			if (!ssa.dom.reachable(b)) continue;
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				if (code.quads[i].def() != Quad::None) assigned[code.quads[i].def()] = 1;
+			}
+		}
+		for (auto& phis : ssa.phis) {
+			for (auto& phi : phis) assigned[phi.dest] = 1;
+		}
+		for (size_t x = 0; x < n; x++) {
+			const Operand& o = code.operands[x];
+			int c;
+			if (o.kind == Operand::Const) {
+				if (code.integer((int)x, c)) set((int)x, c);
+				else if (o.type == Type::Bool) set((int)x, o.name == "true");
+				else state[x] = Varying;
+			}
+			else if (!tracked((int)x) || !assigned[x]) state[x] = Varying;
+		}
+
+		int u[3];
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				block[i] = b;
+				int k = code.quads[i].uses(u);
+				for (int j = 0; j < k; j++) readers[u[j]].push_back(i);
+			}
+			for (size_t p = 0; p < ssa.phis[b].size(); p++) {
+				for (int x : ssa.phis[b][p].args) phiReaders[x].push_back({ b, (int)p });
+			}
+		}
+	}
+
+	bool tracked(int x) const {
+		const Type* t = code.operands[x].type.get();
+		return t == Type::Int.get() || t == Type::Char.get() || t == Type::Bool.get();
+	}
+
+	void set(int x, int c) {
+		state[x] = Constant;
+		value[x] = c;
+	}
+
+	// Lowers x to the meet of its value and the state s with value c
+	void lower(int x, State s, int c) {
+		if (s == Unknown || state[x] == Varying) return;
+		State before = state[x];
+		if (s == Varying || (state[x] == Constant && value[x] != c)) state[x] = Varying;
+		else set(x, c);
+		if (state[x] != before) changed.push_back(x);
+	}
+
+	void propagate() {
+		reached[0] = 1;
+		visit(0);
+		while (!edges.empty() || !changed.empty()) {
+			while (!edges.empty()) {
+				auto e = edges.back(); edges.pop_back();
+				int b = e.second;
+				int j = ssa.edge(b, e.first);
+				if (taken[cfg.predStart[b] + j]) continue;
+				taken[cfg.predStart[b] + j] = 1;
+				if (!reached[b]) { reached[b] = 1; visit(b); }
+				else {
+					for (auto& phi : ssa.phis[b]) evaluate(b, phi);
+				}
+			}
+			while (!changed.empty() && edges.empty()) {
+				int x = changed.back(); changed.pop_back();
+				for (int i : readers[x]) {
+					if (reached[block[i]]) evaluate(i);
+				}
+				for (auto& r : phiReaders[x]) {
+					if (reached[r.first]) evaluate(r.first, ssa.phis[r.first][r.second]);
+				}
+			}
+		}
+	}
+
+	void visit(int b) {
+		for (auto& phi : ssa.phis[b]) evaluate(b, phi);
+		for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) evaluate(i);
+		const Quad& last = code.quads[cfg.blocks[b].end - 1];
+		if (!last.jump() && b + 1 < (int)cfg.blocks.size()) edges.push_back({ b, b + 1 });
+	}
+
+	// Meet of the arguments on the executable edges, block 0 is also
+	// entered from outside
+	void evaluate(int b, const SSA::Phi& phi) {
+		CFG::Edges preds = cfg.predecessors(b);
+		for (size_t j = 0; j < preds.size(); j++) {
+			if (taken[cfg.predStart[b] + j]) lower(phi.dest, state[phi.args[j]], value[phi.args[j]]);
+		}
+		if (b == 0) lower(phi.dest, state[phi.args.back()], value[phi.args.back()]);
+	}
+
+	void evaluate(int i) {
+		const Quad& q = code.quads[i];
+		int b = block[i];
+		switch (q.op) {
+		case Opcode::Goto:
+			edges.push_back({ b, cfg.labels[q.label] });
+			return;
+		case Opcode::If: case Opcode::IfFalse: {
+			int c = 0;
+			State s = condition(q, c);
+			if (s == Unknown) return;
+			if (s == Varying || c) edges.push_back({ b, cfg.labels[q.label] });
+			if ((s == Varying || !c) && b + 1 < (int)cfg.blocks.size()) edges.push_back({ b, b + 1 });
+			return;
+		}
+		default:
+			break;
+		}
+
+		int d = q.def();
+		if (d == Quad::None || state[d] == Varying) return;
+		if (q.op == Opcode::Load) { lower(d, Varying, 0); return; }
+		int a = q.src1, z = q.src2 != Quad::None ? q.src2 : q.src1;
+		if (state[a] == Varying || state[z] == Varying) lower(d, Varying, 0);
+		else if (state[a] == Constant && state[z] == Constant) {
+			int c = value[a];
+			if (q.op != Opcode::Copy && !Numbering::fold(q.op, value[a], value[z], c)) lower(d, Varying, 0);
+			else lower(d, Constant, c);
+		}
+	}
+
+	// Whether a conditional jump is taken, in c if the state is constant
+	State condition(const Quad& q, int& c) {
+		int a = q.src1, z = q.rel != Relop::None ? q.src2 : q.src1;
+		if (state[a] == Varying || state[z] == Varying) return Varying;
+		if (state[a] == Unknown || state[z] == Unknown) return Unknown;
+		int x = value[a], y = value[z];
+		switch (q.rel) {
+		case Relop::None: c = x != 0; break;
+		case Relop::Lt: c = x < y; break;
+		case Relop::Le: c = x <= y; break;
+		case Relop::Gt: c = x > y; break;
+		case Relop::Ge: c = x >= y; break;
+		case Relop::Eq: c = x == y; break;
+		case Relop::Ne: c = x != y; break;
+		}
+		if (q.op == Opcode::IfFalse) c = !c;
+		return Constant;
+	}
+
+	int constant(int x) {
+		if (code.operands[x].type == Type::Bool) return code.constant(value[x] ? "true" : "false", Type::Bool);
+		return code.constant(value[x]);
+	}
+
+	bool known(int x) const {
+		return code.operands[x].kind != Operand::Const && state[x] == Constant;
+	}
+
+	// Substitutes the constants and resolves the jumps in SSA form, then
+	// leaves it without the blocks never reached
+	int rewrite() {
+		std::vector<Quad>& quads = code.quads;
+		std::vector<char> removed(quads.size(), 0);
+		int simplified = 0;
+		int* p[3];
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			if (!reached[b]) {
+				// Never executed, the block goes with its labels and phis
+				ssa.phis[b].clear();
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					removed[i] = 1;
+					if (quads[i].op != Opcode::Label) simplified++;
+				}
+				continue;
+			}
+			auto& phis = ssa.phis[b];
+			size_t k = 0;
+			for (auto& phi : phis) {
+				if (known(phi.dest) && !ssa.result(phi.dest)) continue;
+				for (int& x : phi.args) {
+					if (known(x)) x = constant(x);
+				}
+				phis[k++] = phi;
+			}
+			phis.resize(k);
+
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				Quad& q = quads[i];
+				int d = q.def(), c = 0;
+				if ((q.op == Opcode::If || q.op == Opcode::IfFalse) && condition(q, c) == Constant) {
+					if (c) {
+						int label = q.label;
+						q = Quad(Opcode::Goto);
+						q.label = label;
+					}
+					else removed[i] = 1;
+					simplified++;
+					continue;
+				}
+				int n = q.uses(p);
+				for (int j = 0; j < n; j++) {
+					if (((q.op == Opcode::Load || q.op == Opcode::Check) && p[j] == &q.src1) || (q.op == Opcode::Store && p[j] == &q.dest)) continue;
+					if (known(*p[j])) *p[j] = constant(*p[j]);
+				}
+				if (d != Quad::None && known(d)) {
+					if (code.operands[d].kind == Operand::Temp) removed[i] = 1;
+					else if (q.op != Opcode::Copy || q.src1 != constant(d)) q = Quad(Opcode::Copy, d, constant(d));
+					else continue;
+					simplified++;
+				}
+			}
+		}
+		ssa.leave(removed);
+		return simplified;
+	}
+};
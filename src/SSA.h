@@ -0,0 +1,389 @@
+#pragma once
+#include "Analyses.h"
+
+/*
+	Static single assignment form of the three-address code. Variables and
+	temporaries assigned more than once or live across blocks get a new
+	version at each assignment, with phi functions placed in the dominance
+	frontiers of the assignments where the name is live (pruned SSA).
+	Arrays keep their name, a store changes one element only.
+
+	The phis are kept beside the code: the arguments of a phi follow the
+	predecessors of its block in the graph, block 0 has one more for the
+	values on entry to the program. Built from the analyses of the code,
+	the form takes its graph from them and leaving it invalidates them
+*/
+class SSA {
+public:
+	struct Phi {
+		int dest;
+		int origin; // Name the phi merges versions of
+		std::vector<int> args;
+	};
+
+	Code& code;
+	CFG cfg;
+	Dominators dom;
+	std::vector<std::vector<Phi> > phis;
+	std::vector<int> exit; // Version of each name at the end of the code
+
+	SSA(Code& c) : code(c), cfg(c), dom(cfg) { index(); build(Liveness(c, cfg)); }
+	SSA(Code& c, Analyses& a) : code(c), cfg(a.cfg()), dom(a.dom()), analyses(&a) { index(); build(a.live()); }
+
+	// Phis of a block are evaluated at once on the edge from predecessor p,
+	// the index of that edge among the arguments
+	int edge(int b, int p) const {
+		for (const std::pair<int, int>& e : edges[p]) {
+			if (e.first == b) return e.second;
+		}
+		return -1;
+	}
+
+	// A version holding the value of its variable at the end of the code
+	bool result(int x) const {
+		const Operand& o = code.operands[x];
+		int v = o.version > 0 ? o.origin : x;
+		return code.operands[v].kind == Operand::Var && exit[v] == x;
+	}
+
+	// Replaces the phis with copies and merges the versions of each name
+	// that do not interfere back into the name. The instructions marked in
+	// removed are left out, the instructions in before are placed ahead
+	// of the labels of each block and the ones in after follow each
+	// instruction. Returns the new position of each instruction of the
+	// code in SSA form, -1 if it was removed
+	std::vector<int> leave(const std::vector<char>& removed = {}, const std::vector<std::vector<Quad> >& before = {},
+		const std::vector<std::vector<Quad> >& after = {}) {
+		std::vector<Quad>& quads = code.quads;
+		int count = (int)cfg.blocks.size();
+
+		// A phi becomes a copy into a temporary at the end of each
+		// predecessor and a copy from it at the start of its block. The
+		// phis of a name share the temporary, their arguments from a block
+		// are the same version, and the copies made on the other edges of
+		// a predecessor are harmless
+		int number = 0;
+		for (Operand& o : code.operands) {
+			if (o.kind == Operand::Temp) number = std::max(number, o.number);
+		}
+		std::vector<std::vector<std::pair<int, int> > > head(count), tail(count);
+		std::vector<std::pair<int, int> > start;
+		std::vector<int> group(code.operands.size(), -1), carrier(code.operands.size(), -1);
+		auto add = [](std::vector<std::pair<int, int> >& list, int t, int x) {
+			for (auto& c : list) {
+				if (c.first == t) return;
+			}
+			list.push_back({ t, x });
+		};
+		for (int b = 0; b < count; b++) {
+			for (Phi& phi : phis[b]) {
+				int& t = carrier[phi.origin];
+				if (t < 0) {
+					t = code.temp(code.operands[phi.origin].type, ++number);
+					group.resize(code.operands.size(), -1);
+					group[t] = phi.origin;
+				}
+				CFG::Edges preds = cfg.predecessors(b);
+				for (size_t j = 0; j < preds.size(); j++) {
+					int p = preds.begin()[j];
+					if (dom.reachable(p)) add(tail[p], t, phi.args[j]);
+				}
+				if (b == 0) add(start, t, phi.args.back());
+				head[b].push_back({ phi.dest, t });
+			}
+			phis[b].clear();
+		}
+
+		std::vector<Quad> result;
+		std::vector<int> moved(quads.size(), -1);
+		auto copies = [&](std::vector<std::pair<int, int> >& list) {
+			for (auto& c : list) result.push_back(Quad(Opcode::Copy, c.first, c.second));
+		};
+		copies(start);
+		for (int b = 0; b < count; b++) {
+			int i = cfg.blocks[b].begin, end = cfg.blocks[b].end;
+			auto keep = [&](int i) {
+				if (removed.empty() || !removed[i]) { moved[i] = (int)result.size(); result.push_back(quads[i]); }
+			};
+			if (!before.empty()) result.insert(result.end(), before[b].begin(), before[b].end());
+			for (; i < end && quads[i].op == Opcode::Label; i++) keep(i);
+			copies(head[b]);
+			int last = end > i && quads[end - 1].jump() ? end - 1 : end;
+			for (; i < last; i++) {
+				keep(i);
+				if (!after.empty()) result.insert(result.end(), after[i].begin(), after[i].end());
+			}
+			copies(tail[b]);
+			if (last < end) keep(last);
+		}
+		quads.swap(result);
+
+		// Each version is merged into the first class of its name holding
+		// none of its neighbors, the first class takes the name itself. The
+		// name is in it from the start, its value on entry may still be read
+		size_t size = code.operands.size();
+		for (size_t x = 0; x < group.size(); x++) {
+			if (code.operands[x].version > 0) group[x] = group[code.operands[x].origin] = code.operands[x].origin;
+		}
+		std::vector<std::vector<int> > edges(size);
+		interference(group, edges);
+		std::vector<std::vector<int> > members(size);
+		for (size_t x = 0; x < group.size(); x++) {
+			if (group[x] >= 0) members[group[x]].push_back((int)x);
+		}
+		std::vector<int> rename(size), in(size, -1), heads;
+		std::vector<char> taken;
+		for (size_t x = 0; x < size; x++) rename[x] = (int)x;
+		for (size_t o = 0; o < size; o++) {
+			if (members[o].empty()) continue;
+			heads.assign(1, (int)o);
+			in[o] = 0;
+			for (int m : members[o]) {
+				taken.assign(heads.size(), 0);
+				for (int y : edges[m]) {
+					if (in[y] >= 0) taken[in[y]] = 1;
+				}
+				size_t c = 0;
+				while (c < heads.size() && taken[c]) c++;
+				if (c == heads.size()) heads.push_back(m);
+				in[m] = (int)c;
+				rename[m] = heads[c];
+			}
+		}
+
+		// Rename, copies between merged names disappear
+		int* p[3];
+		std::vector<int> position(quads.size(), -1);
+		int j = 0;
+		for (size_t i = 0; i < quads.size(); i++) {
+			Quad q = quads[i];
+			int n = q.uses(p);
+			for (int k = 0; k < n; k++) *p[k] = rename[*p[k]];
+			if (q.def() != Quad::None) q.dest = rename[q.dest];
+			if (q.op == Opcode::Copy && q.dest == q.src1) continue;
+			position[i] = j;
+			quads[j++] = q;
+		}
+		quads.erase(quads.begin() + j, quads.end());
+		for (int& m : moved) {
+			if (m >= 0) m = position[m];
+		}
+		if (analyses != nullptr) analyses->invalidate(Analyses::Graph);
+		return moved;
+	}
+
+	void print(Sink& out) const {
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			int i = cfg.blocks[b].begin, end = cfg.blocks[b].end;
+			for (; i < end && code.quads[i].op == Opcode::Label; i++) code.format(code.quads[i], out);
+			for (const Phi& phi : phis[b]) {
+				out.put('\t');
+				code.operand(phi.dest, out);
+				out.write(" = phi(");
+				for (size_t k = 0; k < phi.args.size(); k++) {
+					if (k > 0) out.write(", ");
+					code.operand(phi.args[k], out);
+				}
+				out.write(")\n");
+			}
+			for (; i < end; i++) code.format(code.quads[i], out);
+		}
+	}
+
+private:
+	Analyses* analyses = nullptr; // Of the code the form was built from
+	std::vector<std::vector<std::pair<int, int> > > edges; // Successors of each block and its index among their predecessors
+
+	// A block joined from many others would be searched for each of them
+	void index() {
+		edges.assign(cfg.blocks.size(), {});
+		for (int s = 0; s < (int)cfg.blocks.size(); s++) {
+			CFG::Edges preds = cfg.predecessors(s);
+			for (size_t j = 0; j < preds.size(); j++) {
+				int p = preds.begin()[j];
+				if (edge(s, p) < 0) edges[p].push_back({ s, (int)j });
+			}
+		}
+	}
+
+	bool renamable(int x) const {
+		const Operand& o = code.operands[x];
+		return o.kind == Operand::Temp || (o.kind == Operand::Var && dynamic_cast<Array*>(o.type.get()) == nullptr);
+	}
+
+	void build(const Liveness& live) {
+		std::vector<Quad>& quads = code.quads;
+		int count = (int)cfg.blocks.size();
+		size_t n = code.operands.size();
+
+		// Blocks assigning each name. A name assigned once and used only in
+		// its block after the assignment is in SSA form already
+		std::vector<std::vector<int> > sites(n);
+		std::vector<int> defs(n, 0);
+		for (int b = 0; b < count; b++) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				int d = quads[i].def();
+				if (d == Quad::None || !renamable(d)) continue;
+				defs[d]++;
+				if (sites[d].empty() || sites[d].back() != b) sites[d].push_back(b);
+			}
+		}
+		std::vector<char> renamed(n, 0);
+		for (size_t x = 0; x < n; x++) renamed[x] = defs[x] > 1 || (defs[x] == 1 && live.index[x] >= 0);
+
+		// Phis in the iterated dominance frontier where the name is live
+		phis.assign(count, {});
+		std::vector<int> placed(count, -1), added(count, -1), work;
+		for (int x : live.names) {
+			if (!renamed[x]) continue;
+			work = sites[x];
+			for (int b : work) added[b] = x;
+			while (!work.empty()) {
+				int b = work.back(); work.pop_back();
+				for (int d : dom.frontier[b]) {
+					if (placed[d] == x || !live.liveIn(d, x)) continue;
+					placed[d] = x;
+					size_t args = cfg.predecessors(d).size() + (d == 0 ? 1 : 0);
+					phis[d].push_back({ x, x, std::vector<int>(args, x) });
+					if (added[d] != x) { added[d] = x; work.push_back(d); }
+				}
+			}
+		}
+
+		// Rename in a preorder walk of the dominator tree, the versions of
+		// a block are popped when the walk leaves it
+		std::vector<std::vector<int> > stacks(n);
+		std::vector<int> versions(n, 0);
+		exit.resize(n);
+		for (size_t x = 0; x < n; x++) exit[x] = (int)x;
+		auto top = [&](int x) { return stacks[x].empty() ? x : stacks[x].back(); };
+		auto define = [&](int x, std::vector<int>& pushed) {
+			int v = code.version(x, ++versions[x]);
+			stacks[x].push_back(v);
+			pushed.push_back(x);
+			return v;
+		};
+		struct Frame { int block; size_t child; std::vector<int> pushed; };
+		std::vector<Frame> stack;
+		int* p[3];
+		if (count > 0) stack.push_back({ 0, 0, {} });
+		bool entering = true;
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			int b = f.block;
+			if (entering) {
+				for (Phi& phi : phis[b]) phi.dest = define(phi.origin, f.pushed);
+				for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+					Quad& q = quads[i];
+					int k = q.uses(p);
+					for (int j = 0; j < k; j++) {
+						if (*p[j] < (int)n && renamed[*p[j]]) *p[j] = top(*p[j]);
+					}
+					int d = q.def();
+					if (d != Quad::None && renamed[d]) q.dest = define(d, f.pushed);
+				}
+				if (b == count - 1) {
+					for (size_t x = 0; x < n; x++) exit[x] = top((int)x);
+				}
+				for (int s : cfg.successors(b)) {
+					int j = edge(s, b);
+					for (Phi& phi : phis[s]) phi.args[j] = top(phi.origin);
+				}
+			}
+			if (f.child < dom.children[b].size()) {
+				int c = dom.children[b][f.child++];
+				stack.push_back({ c, 0, {} });
+				entering = true;
+			}
+			else {
+				for (int x : f.pushed) stacks[x].pop_back();
+				stack.pop_back();
+				entering = false;
+			}
+		}
+	}
+
+	// Versions of one name interfere if one is live where the other is
+	// assigned, except by the copy of one into the other. Unreachable
+	// blocks were not renamed and never run, they are left out
+	void interference(const std::vector<int>& group, std::vector<std::vector<int> >& edges) {
+		CFG g(code);
+		Dominators tree(g);
+		std::vector<Quad>& quads = code.quads;
+		std::vector<std::vector<int> > out;
+		liveness(g, group, out);
+		std::vector<char> alive(code.operands.size(), 0);
+		std::vector<int> set;
+		int u[3];
+		for (int b = 0; b < (int)g.blocks.size(); b++) {
+			if (!tree.reachable(b)) continue;
+			set = out[b];
+			for (int x : set) alive[x] = 1;
+			for (int i = g.blocks[b].end - 1; i >= g.blocks[b].begin; i--) {
+				const Quad& q = quads[i];
+				int d = q.def();
+				if (d != Quad::None && group[d] >= 0) {
+					size_t k = 0;
+					for (int y : set) {
+						if (!alive[y]) continue;
+						set[k++] = y;
+						if (y != d && group[y] == group[d] && !(q.op == Opcode::Copy && q.src1 == y)) {
+							edges[d].push_back(y);
+							edges[y].push_back(d);
+						}
+					}
+					set.resize(k);
+					alive[d] = 0;
+				}
+				int n = q.uses(u);
+				for (int j = 0; j < n; j++) {
+					if (group[u[j]] >= 0 && !alive[u[j]]) { alive[u[j]] = 1; set.push_back(u[j]); }
+				}
+			}
+			for (int y : set) alive[y] = 0;
+		}
+	}
+
+	// Members of the groups live out of each block. The versions have short
+	// lives, so each is followed back from its uses to its assignments
+	// rather than solving for all of them in every block
+	void liveness(const CFG& g, const std::vector<int>& group, std::vector<std::vector<int> >& out) {
+		std::vector<Quad>& quads = code.quads;
+		int count = (int)g.blocks.size();
+		size_t size = code.operands.size();
+		std::vector<std::vector<int> > defs(size), uses(size);
+		std::vector<int> defined(size, -1);
+		int u[3];
+		for (int b = 0; b < count; b++) {
+			for (int i = g.blocks[b].begin; i < g.blocks[b].end; i++) {
+				int n = quads[i].uses(u);
+				for (int k = 0; k < n; k++) {
+					int x = u[k];
+					if (group[x] >= 0 && defined[x] != b && (uses[x].empty() || uses[x].back() != b)) uses[x].push_back(b);
+				}
+				int d = quads[i].def();
+				if (d != Quad::None && group[d] >= 0 && defined[d] != b) {
+					defined[d] = b;
+					defs[d].push_back(b);
+				}
+			}
+		}
+
+		out.assign(count, {});
+		std::vector<int> assigns(count, -1), in(count, -1), through(count, -1), work;
+		for (size_t x = 0; x < size; x++) {
+			if (uses[x].empty()) continue;
+			for (int b : defs[x]) assigns[b] = (int)x;
+			for (int b : uses[x]) { in[b] = (int)x; work.push_back(b); }
+			while (!work.empty()) {
+				int b = work.back(); work.pop_back();
+				for (int p : g.predecessors(b)) {
+					if (through[p] == (int)x) continue;
+					through[p] = (int)x;
+					out[p].push_back((int)x);
+					if (assigns[p] != (int)x && in[p] != (int)x) { in[p] = (int)x; work.push_back(p); }
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+	Destination of the generated code. Text is appended to a buffer
+	and handed to the sink only when the buffer is full or flushed
+*/
+class Sink {
+public:
+	virtual ~Sink() {}
+
+	void write(const char* s, size_t n) {
+		if (n <= (size_t)(end - next)) {
+			std::memcpy(next, s, n);
+			next += n;
+		}
+		else overflow(s, n);
+	}
+
+	void write(const std::string& s) { write(s.data(), s.size()); }
+	void write(const char* s) { write(s, std::strlen(s)); }
+
+	// Appends the digits of a label or temporary number without
+	// formatting through a stream
+	void number(int i) {
+		char digits[12];
+		char* p = digits + sizeof(digits);
+		unsigned u = i < 0 ? 0u - (unsigned)i : (unsigned)i;
+		do { *--p = (char)('0' + u % 10); u /= 10; } while (u != 0);
+		if (i < 0) *--p = '-';
+		write(p, digits + sizeof(digits) - p);
+	}
+
+	void put(char c) {
+		if (next == end) overflow(&c, 1);
+		else *next++ = c;
+	}
+
+	virtual void flush() {}
+
+protected:
+	char* begin = nullptr; // Buffer of the sink, next is the free space
+	char* next = nullptr;
+	char* end = nullptr;
+
+	// Takes the buffered text followed by n more bytes that do not fit
+	virtual void overflow(const char* s, size_t n) = 0;
+};
+
+/*
+	Sink into a file descriptor. The buffer is large enough to keep the
+	number of system calls low even for millions of instructions
+*/
+class FileSink : public Sink {
+public:
+	static const size_t capacity = 1 << 20;
+
+	FileSink(int fd = STDOUT_FILENO) : fd(fd), owned(false), buffer(capacity) { reset(); }
+
+	FileSink(const char* filename) : owned(true), buffer(capacity) {
+		fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) throw std::runtime_error(std::string("Can not open ") + filename);
+		reset();
+	}
+
+	~FileSink() {
+		try { flush(); }
+		catch (std::exception&) {}
+		if (owned) ::close(fd);
+	}
+
+	void flush() override {
+		struct iovec iov[1] = { { begin, (size_t)(next - begin) } };
+		drain(iov, 1);
+		reset();
+	}
+
+protected:
+	void overflow(const char* s, size_t n) override {
+		if (n < capacity) {
+			flush();
+			write(s, n);
+			return;
+		}
+		// A large block goes out together with the buffer in one call
+		struct iovec iov[2] = { { begin, (size_t)(next - begin) }, { (void*)s, n } };
+		drain(iov, 2);
+		reset();
+	}
+
+private:
+	int fd;
+	bool owned; // The descriptor was opened by the sink
+	std::vector<char> buffer;
+
+	void reset() {
+		begin = next = buffer.data();
+		end = begin + buffer.size();
+	}
+
+	// Writes all of the blocks, resuming after partial writes
+	void drain(struct iovec* iov, int count) {
+		while (count > 0) {
+			if (iov->iov_len == 0) { iov++; count--; continue; }
+			ssize_t n = ::writev(fd, iov, count);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error(std::string("Can not write output: ") + std::strerror(errno));
+			}
+			while (count > 0 && (size_t)n >= iov->iov_len) {
+				n -= iov->iov_len;
+				iov++; count--;
+			}
+			if (count > 0) {
+				iov->iov_base = (char*)iov->iov_base + n;
+				iov->iov_len -= n;
+			}
+		}
+	}
+};
+
+/*
+	Sink into memory, for embedding the compiler into other programs
+*/
+class MemorySink : public Sink {
+public:
+	MemorySink() : buffer(4096) { reset(0); }
+
+	std::string str() const { return std::string(begin, next); }
+	const char* data() const { return begin; }
+	size_t size() const { return next - begin; }
+	void clear() { reset(0); }
+
+protected:
+	void overflow(const char* s, size_t n) override {
+		size_t size = next - begin;
+		buffer.resize(std::max(buffer.size() * 2, size + n));
+		reset(size);
+		write(s, n);
+	}
+
+private:
+	std::vector<char> buffer;
+
+	void reset(size_t size) {
+		begin = buffer.data();
+		next = begin + size;
+		end = begin + buffer.size();
+	}
+};
@@ -0,0 +1,143 @@
+#pragma once
+#include "Inter.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <cstdlib>
+#include <new>
+#include <typeindex>
+#include <unordered_set>
+#include <cxxabi.h>
+#include <sys/resource.h>
+
+/*
+	Heap usage of the process, counted by the global operator new and
+	delete of main.cpp while counting is on. Each block starts with a
+	header holding the size it was counted with, 0 when not counted
+*/
+struct Heap {
+	static std::atomic<size_t> allocated; // Bytes allocated since start
+	static std::atomic<size_t> allocations;
+	static std::atomic<size_t> live; // Bytes currently allocated
+	static bool counting; // Set for the statistics only
+
+	static const size_t header = alignof(std::max_align_t);
+
+	static void* allocate(size_t n) {
+		char* p = (char*)std::malloc(n + header);
+		if (p == nullptr) throw std::bad_alloc();
+		*(size_t*)p = counting ? n : 0;
+		if (counting) {
+			allocated.fetch_add(n, std::memory_order_relaxed);
+			allocations.fetch_add(1, std::memory_order_relaxed);
+			live.fetch_add(n, std::memory_order_relaxed);
+		}
+		return p + header;
+	}
+
+	static void deallocate(void* q) {
+		if (q == nullptr) return;
+		char* p = (char*)q - header;
+		if (*(size_t*)p > 0) live.fetch_sub(*(size_t*)p, std::memory_order_relaxed);
+		std::free(p);
+	}
+
+	// Peak resident set size in bytes
+	static size_t peak() {
+		struct rusage r;
+		getrusage(RUSAGE_SELF, &r);
+#ifdef __APPLE__
+		return (size_t)r.ru_maxrss;
+#else
+		return (size_t)r.ru_maxrss * 1024;
+#endif
+	}
+};
+
+/*
+	Statistics of a compilation, recorded at the end of each phase
+*/
+class Stats {
+public:
+	struct Phase {
+		std::string name;
+		double seconds;
+		size_t allocated; // Bytes allocated during the phase
+		size_t allocations;
+		size_t live;
+		size_t peak;
+	};
+
+	std::vector<Phase> phases;
+	std::map<std::string, size_t> counters; // Tokens, temporaries, ...
+	std::map<std::string, size_t> nodes; // AST nodes by class
+
+	Stats() { mark(); }
+
+	// Closes the phase that started at the previous mark
+	void phase(std::string name) {
+		auto now = std::chrono::steady_clock::now();
+		size_t allocated = Heap::allocated.load(), allocations = Heap::allocations.load();
+		phases.push_back({ name, std::chrono::duration<double>(now - start).count(),
+			allocated - allocatedAtStart, allocations - allocationsAtStart, Heap::live.load(), Heap::peak() });
+		mark();
+	}
+
+	// Counts the distinct nodes of the AST by class, the DAG shares
+	// expression nodes between several parents
+	void count(Node* root) {
+		std::map<std::type_index, size_t> byType;
+		std::unordered_set<Node*> visited = { root };
+		std::vector<Node*> stack = { root };
+		while (!stack.empty()) {
+			Node* n = stack.back(); stack.pop_back();
+			byType[std::type_index(typeid(*n))]++;
+			for (Node* c : n->children()) {
+				if (visited.insert(c).second) stack.push_back(c);
+			}
+		}
+		for (auto& t : byType) nodes[demangle(t.first.name())] += t.second;
+	}
+
+	void report(std::ostream& os) {
+		os << std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "time (ms)"
+			<< std::setw(16) << "allocated" << std::setw(14) << "allocations"
+			<< std::setw(16) << "live bytes" << std::setw(16) << "peak rss" << std::endl;
+		for (Phase& p : phases) {
+			os << std::left << std::setw(10) << p.name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << p.seconds * 1000
+				<< std::setw(16) << p.allocated << std::setw(14) << p.allocations
+				<< std::setw(16) << p.live << std::setw(16) << p.peak << std::endl;
+		}
+		for (auto& c : counters) os << std::left << std::setw(24) << c.first << std::right << c.second << std::endl;
+		os << "nodes" << std::endl;
+		for (auto& n : nodes) os << "  " << std::left << std::setw(22) << n.first << std::right << n.second << std::endl;
+	}
+
+	json toJson() {
+		json j = { { "counters", counters }, { "nodes", nodes }, { "phases", json::array() } };
+		for (Phase& p : phases) {
+			j["phases"].push_back({ { "name", p.name }, { "seconds", p.seconds }, { "allocated", p.allocated },
+				{ "allocations", p.allocations }, { "live", p.live }, { "peak_rss", p.peak } });
+		}
+		return j;
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+	size_t allocatedAtStart, allocationsAtStart;
+
+	void mark() {
+		start = std::chrono::steady_clock::now();
+		allocatedAtStart = Heap::allocated.load();
+		allocationsAtStart = Heap::allocations.load();
+	}
+
+	static std::string demangle(const char* name) {
+		int status = 0;
+		char* s = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		std::string result = status == 0 ? s : name;
+		std::free(s);
+		return result;
+	}
+};
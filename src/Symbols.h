@@ -8,10 +8,10 @@ class Type : public Word {
 public:
 	Type(std::string s, int tag, int w) : Word(s, tag), width(w) {}
 	int width;
-	static std::shared_ptr<Type> Int;
-	static std::shared_ptr<Type> Float;
-	static std::shared_ptr<Type> Char;
-	static std::shared_ptr<Type> Bool;
+	static const std::shared_ptr<Type> Int;
+	static const std::shared_ptr<Type> Float;
+	static const std::shared_ptr<Type> Char;
+	static const std::shared_ptr<Type> Bool;
 
 	static bool numeric(std::shared_ptr<Type> p) {
 		if (p == Char || p == Int || p == Float) return true;
@@ -26,10 +26,10 @@ public:
 	}
 };
 
-std::shared_ptr<Type> Type::Int   = std::make_shared<Type>("int", BASIC, 4);
-std::shared_ptr<Type> Type::Float = std::make_shared<Type>("float", BASIC, 8);
-std::shared_ptr<Type> Type::Char  = std::make_shared<Type>("char", BASIC, 1);
-std::shared_ptr<Type> Type::Bool  = std::make_shared<Type>("bool", BASIC, 1);
+const std::shared_ptr<Type> Type::Int   = std::make_shared<Type>("int", BASIC, 4);
+const std::shared_ptr<Type> Type::Float = std::make_shared<Type>("float", BASIC, 8);
+const std::shared_ptr<Type> Type::Char  = std::make_shared<Type>("char", BASIC, 1);
+const std::shared_ptr<Type> Type::Bool  = std::make_shared<Type>("bool", BASIC, 1);
 
 /*
 	Data Array Token
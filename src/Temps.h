@@ -0,0 +1,171 @@
+#pragma once
+#include "Analyses.h"
+#include <functional>
+#include <map>
+#include <queue>
+
+/*
+	Renumbers the temporaries into as few slots as possible, a slot is
+	shared by temporaries that are never live at the same time. The
+	temporaries live across blocks are colored first, the ones local to
+	a block are then packed into the slots free in their block. A slot
+	holding temporaries of several types gets one temporary of each
+*/
+class Temps {
+public:
+	// Returns the number of temporaries left
+	static int run(Code& code, Analyses& analyses) {
+		const CFG& cfg = analyses.cfg();
+		const Liveness& live = analyses.live();
+		std::vector<Quad>& quads = code.quads;
+		size_t count = code.operands.size();
+		int u[3];
+
+		// Vector temporaries keep their own
+		auto temp = [&](int x) { return x != Quad::None && code.operands[x].kind == Operand::Temp && code.lanes(x) == 0; };
+		auto global = [&](int x) { return live.index[x] >= 0; };
+
+		// Interference of the temporaries live across blocks: one is live
+		// where the other is assigned
+		std::vector<std::vector<int> > edges(live.names.size());
+		std::vector<char> alive(count, 0);
+		std::vector<int> set;
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			set.clear();
+			for (int x : live.names) {
+				if (temp(x) && live.liveOut(b, x)) { alive[x] = 1; set.push_back(x); }
+			}
+			for (int i = cfg.blocks[b].end - 1; i >= cfg.blocks[b].begin; i--) {
+				int d = quads[i].def();
+				if (temp(d) && global(d)) {
+					for (int y : set) {
+						if (alive[y] && y != d) {
+							edges[live.index[d]].push_back(y);
+							edges[live.index[y]].push_back(d);
+						}
+					}
+					alive[d] = 0;
+				}
+				int n = quads[i].uses(u);
+				for (int k = 0; k < n; k++) {
+					if (temp(u[k]) && global(u[k]) && !alive[u[k]]) { alive[u[k]] = 1; set.push_back(u[k]); }
+				}
+			}
+			for (int y : set) alive[y] = 0;
+		}
+
+		// Color them with the lowest slot free of their neighbors
+		std::vector<int> slot(count, -1);
+		std::vector<char> taken;
+		int slots = 0;
+		for (int x : live.names) {
+			if (!temp(x)) continue;
+			taken.assign(slots + 1, 0);
+			for (int y : edges[live.index[x]]) {
+				if (slot[y] >= 0) taken[slot[y]] = 1;
+			}
+			int s = 0;
+			while (taken[s]) s++;
+			slot[x] = s;
+			slots = std::max(slots, s + 1);
+		}
+
+		// Pack the local temporaries block by block and rewrite the block
+		// with one temporary per slot. A slot is freed after the last use,
+		// a temporary assigned again takes a new one, and the slots of the
+		// global temporaries of the block stay reserved
+		struct Rewrite { int* at; int slot; std::shared_ptr<Type> type; };
+		std::vector<Rewrite> rewrites;
+		auto rewrite = [&](int& x) { rewrites.push_back({ &x, slot[x], code.operands[x].type }); };
+		struct Death { int at, temp; bool def; };
+		std::vector<Death> deaths;
+		std::vector<char> reserved;
+		std::vector<int> locals;
+		int* p[3];
+		for (int b = 0; b < (int)cfg.blocks.size(); b++) {
+			int begin = cfg.blocks[b].begin, end = cfg.blocks[b].end;
+
+			// Last uses and results never used, found backwards
+			deaths.clear();
+			for (int i = end - 1; i >= begin; i--) {
+				int d = quads[i].def();
+				if (temp(d) && !global(d)) {
+					if (!alive[d]) deaths.push_back({ i, d, true });
+					alive[d] = 0;
+				}
+				int n = quads[i].uses(u);
+				for (int k = 0; k < n; k++) {
+					if (temp(u[k]) && !global(u[k]) && !alive[u[k]]) {
+						alive[u[k]] = 1;
+						deaths.push_back({ i, u[k], false });
+					}
+				}
+			}
+			for (Death& d : deaths) alive[d.temp] = 0;
+
+			reserved.assign(slots, 0);
+			for (int x : live.names) {
+				if (temp(x) && live.liveIn(b, x)) reserved[slot[x]] = 1;
+			}
+			for (int i = begin; i < end; i++) {
+				int d = quads[i].def();
+				if (temp(d) && global(d)) reserved[slot[d]] = 1;
+			}
+
+			std::priority_queue<int, std::vector<int>, std::greater<int> > free;
+			int top = 0;
+			locals.clear();
+			for (int i = begin; i < end; i++) {
+				Quad& q = quads[i];
+				int d = q.def();
+
+				// The operands are read before the result is written, so the
+				// result can take the slot of an operand dying here
+				int n = q.uses(p);
+				for (int k = 0; k < n; k++) {
+					if (temp(*p[k])) rewrite(*p[k]);
+				}
+				bool dead = false;
+				while (!deaths.empty() && deaths.back().at == i) {
+					Death x = deaths.back(); deaths.pop_back();
+					if (x.def) dead = true;
+					else if (x.temp != d) { free.push(slot[x.temp]); slot[x.temp] = -1; }
+				}
+				if (!temp(d)) continue;
+				if (!global(d) && slot[d] < 0) {
+					locals.push_back(d);
+					if (!free.empty()) { slot[d] = free.top(); free.pop(); }
+					else {
+						while (top < (int)reserved.size() && reserved[top]) top++;
+						slot[d] = top++;
+						slots = std::max(slots, top);
+					}
+				}
+				int s = slot[d];
+				rewrite(q.dest);
+				if (dead && !global(d)) { free.push(s); slot[d] = -1; }
+			}
+
+			// A temporary assigned again in another block starts over
+			for (int x : locals) slot[x] = -1;
+		}
+
+		// The first type of a slot keeps its number, the others follow the
+		// slots
+		std::map<std::pair<int, Type*>, int> operand;
+		std::vector<char> numbered(slots, 0);
+		int temps = slots;
+		for (const Rewrite& r : rewrites) {
+			auto key = std::make_pair(r.slot, r.type.get());
+			auto found = operand.find(key);
+			if (found == operand.end()) {
+				int number = numbered[r.slot] ? ++temps : r.slot + 1;
+				numbered[r.slot] = 1;
+				found = operand.insert({ key, code.temp(r.type, number) }).first;
+			}
+			*r.at = found->second;
+		}
+		analyses.invalidate(Analyses::Live); // The blocks stay, the names change
+		return temps;
+	}
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include "Analyses.h"
+#include "Numbering.h"
+#include "SSA.h"
+
+/*
+	Trip counts of bottom-tested loops. The test at the bottom of a loop
+	with a single latch compares a counter with a constant, the counter
+	starting at a constant and stepped by a constant once an iteration.
+	The counters are found on the SSA form of a copy of the code, whose
+	instructions keep their places in the code, and the count by stepping
+	the counter until the test leaves the loop
+*/
+class Trips {
+public:
+	static const int Max = 1 << 20; // Trips counted at most
+
+	// Counter of a loop, the instructions stepping and testing it
+	struct Counter { int trips, start, step, stepped, test; };
+
+	Code form;
+	SSA ssa;
+	Loops nest;
+
+	Trips(const Code& code, Analyses& analyses) : form(code), ssa(form, analyses), nest(analyses.loops()) {
+		const CFG& cfg = ssa.cfg;
+		at.assign(form.operands.size(), -1);
+		block.assign(form.quads.size(), -1);
+		for (int b : ssa.dom.order) {
+			for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+				block[i] = b;
+				if (form.quads[i].def() != Quad::None) at[form.quads[i].def()] = i;
+			}
+		}
+	}
+
+	// Counts the trips of loop l into c, false if not known
+	bool count(int l, Counter& c) const {
+		const CFG& cfg = ssa.cfg;
+		const Loops::Loop& loop = nest.loops[l];
+		int h = loop.header, p = loop.latches[0];
+		if (loop.latches.size() != 1) return false;
+		c.test = cfg.blocks[p].end - 1;
+		const Quad& test = form.quads[c.test];
+		if ((test.op != Opcode::If && test.op != Opcode::IfFalse) || test.rel == Relop::None || cfg.labels[test.label] != h) return false;
+
+		CFG::Edges preds = cfg.predecessors(h);
+		for (const SSA::Phi& phi : ssa.phis[h]) {
+			// One constant on entry and one stepped value on the back edge
+			int i0 = phi.dest, entry = Quad::None, next = Quad::None;
+			bool single = true;
+			for (size_t j = 0; j < phi.args.size(); j++) {
+				if (j < preds.size() && !ssa.dom.reachable(preds.begin()[j])) continue;
+				int& v = j < preds.size() && nest.contains(l, preds.begin()[j]) ? next : entry;
+				single = single && (v == Quad::None || v == phi.args[j]);
+				v = phi.args[j];
+			}
+			int bound;
+			if (!single || entry == Quad::None || next == Quad::None || at[next] < 0) continue;
+			if (!constant(entry, c.start) || !ssa.dom.dominates(block[at[next]], p)) continue;
+			const Quad& s = form.quads[at[next]];
+			if (s.op == Opcode::Sub && s.src1 == i0 && form.integer(s.src2, c.step)) {
+				if (!Numbering::fold(Opcode::Neg, c.step, 0, c.step)) continue;
+			}
+			else if (!(s.op == Opcode::Add && s.src1 == i0 && form.integer(s.src2, c.step))
+				&& !(s.op == Opcode::Add && s.src2 == i0 && form.integer(s.src1, c.step))) continue;
+			c.stepped = at[next];
+
+			// The test of the counter, before or after its step, against a constant
+			bool left = test.src1 == i0 || test.src1 == next;
+			int x = left ? test.src1 : test.src2;
+			if ((x != i0 && x != next) || !form.integer(left ? test.src2 : test.src1, bound)) continue;
+
+			int value = c.start;
+			for (int n = 1; n <= Max; n++) {
+				int stepped;
+				if (!Numbering::fold(Opcode::Add, value, c.step, stepped)) break;
+				int a = x == i0 ? value : stepped, b = bound;
+				if (!left) std::swap(a, b);
+				if (!back(test, a, b)) { c.trips = n; return true; }
+				value = stepped;
+			}
+		}
+		return false;
+	}
+
+private:
+	std::vector<int> at; // Instruction assigning each name, or -1
+	std::vector<int> block; // Block of each instruction
+
+	// Whether x holds an integer constant, copied or folded from constants
+	bool constant(int x, int& value) const {
+		if (form.integer(x, value)) return true;
+		if (at[x] < 0) return false;
+		const Quad& q = form.quads[at[x]];
+		int a, b = 0;
+		if (q.op == Opcode::Copy) return form.integer(q.src1, value);
+		bool binary = q.op == Opcode::Add || q.op == Opcode::Sub || q.op == Opcode::Mul || q.op == Opcode::Div;
+		return (binary || q.op == Opcode::Neg) && form.integer(q.src1, a) && (!binary || form.integer(q.src2, b))
+			&& Numbering::fold(q.op, a, b, value);
+	}
+
+	// Whether the test jumps back to the header on these operands
+	static bool back(const Quad& test, int a, int b) {
+		bool c = false;
+		switch (test.rel) {
+		case Relop::Lt: c = a < b; break;
+		case Relop::Le: c = a <= b; break;
+		case Relop::Gt: c = a > b; break;
+		case Relop::Ge: c = a >= b; break;
+		case Relop::Eq: c = a == b; break;
+		case Relop::Ne: c = a != b; break;
+		default: break;
+		}
+		return test.op == Opcode::If ? c : !c;
+	}
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "Trips.h"
+
+/*
+	Loop unrolling. An innermost loop laid out as one run of blocks, left
+	only by the test at its bottom, runs a known number of times when the
+	test compares a counter started at a constant and stepped by a constant
+	with a constant. A short loop is unrolled into as many copies of its
+	body, the tests dropped. A longer one is unrolled by a factor: the
+	copies of the body repeat with only the last one tested, after as many
+	copies as the trip count leaves over the factor
+*/
+class Unroll {
+public:
+	static const int Factor = 4; // Copies of the body in a loop partially unrolled
+	static const int Limit = 64; // Instructions of the copies at most
+
+	// Returns the number of loops unrolled
+	static int run(Code& code, Analyses& analyses, int factor = Factor) {
+		if (code.quads.empty()) return 0;
+		std::vector<Quad>& quads = code.quads;
+
+		Trips counters(code, analyses);
+		const CFG& cfg = counters.ssa.cfg;
+		const Loops& nest = counters.nest;
+		int label = 0;
+		for (const Quad& q : quads) label = std::max(label, q.label);
+		std::vector<int> jumps(label + 1, 0);
+		for (const Quad& q : quads) {
+			if (q.jump()) jumps[q.label]++;
+		}
+
+		std::vector<Plan> plans;
+		for (int l = 0; l < (int)nest.loops.size(); l++) {
+			const Loops::Loop& loop = nest.loops[l];
+			int h = loop.header, p = loop.latches[0];
+			if (loop.latches.size() != 1 || loop.exits.size() > 1 || (loop.exits.size() == 1 && loop.exits[0] != p)) continue;
+			if (p - h + 1 != (int)loop.blocks.size()) continue;
+			bool inner = true;
+			for (int b : loop.blocks) inner = inner && b >= h && b <= p && nest.innermost[b] == l;
+			if (!inner) continue;
+			Trips::Counter counter;
+			if (!counters.count(l, counter)) continue;
+			int trips = counter.trips;
+
+			// Instructions of the body besides its labels and test
+			Plan plan = { cfg.blocks[h].begin, cfg.blocks[p].end, cfg.blocks[h].begin, 0, 0 };
+			while (quads[plan.labels].op == Opcode::Label) plan.labels++;
+			int size = 0;
+			for (int i = plan.begin; i < plan.end - 1; i++) size += quads[i].op != Opcode::Label;
+			if ((long long)trips * size <= Limit) plan.peel = trips;
+			else if (factor >= 2 && trips >= factor && (size + 1) * (factor + trips % factor) <= Limit) {
+				plan.peel = trips % factor;
+				plan.factor = factor;
+			}
+			else continue;
+			plans.push_back(plan);
+		}
+		if (plans.empty()) return 0;
+		std::sort(plans.begin(), plans.end(), [](const Plan& a, const Plan& b) { return a.begin < b.begin; });
+
+		std::vector<Quad> result;
+		size_t k = 0;
+		for (int i = 0; i < (int)quads.size(); i++) {
+			if (k == plans.size() || i != plans[k].begin) { result.push_back(quads[i]); continue; }
+			const Plan& plan = plans[k++];
+
+			// The loop left starts after the copies peeled, at a new label if
+			// there are any. The labels of the header stay if jumped to from
+			// outside the loop
+			int start = quads[plan.end - 1].label;
+			if (plan.factor > 0 && plan.peel > 0) start = ++label;
+			for (int j = plan.begin; j < plan.labels; j++) {
+				int outside = jumps[quads[j].label] - (quads[j].label == quads[plan.end - 1].label);
+				if (outside > 0 || (quads[j].label == start && plan.peel == 0)) result.push_back(quads[j]);
+			}
+			for (int c = 0; c < plan.peel + plan.factor; c++) {
+				if (c == plan.peel && start != quads[plan.end - 1].label) {
+					Quad q(Opcode::Label);
+					q.label = start;
+					result.push_back(q);
+				}
+
+				// Labels in the body are renamed in each copy but the first
+				std::map<int, int> names;
+				for (int j = plan.labels; j < plan.end - 1; j++) {
+					if (quads[j].op == Opcode::Label) names[quads[j].label] = c == 0 ? quads[j].label : ++label;
+				}
+				for (int j = plan.labels; j < plan.end - 1; j++) {
+					Quad q = quads[j];
+					if (q.op == Opcode::Label || q.jump()) q.label = names[q.label];
+					result.push_back(q);
+				}
+				if (c == plan.peel + plan.factor - 1 && plan.factor > 0) {
+					Quad q = quads[plan.end - 1];
+					q.label = start;
+					result.push_back(q);
+				}
+			}
+			i = plan.end - 1;
+		}
+		quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return (int)plans.size();
+	}
+
+private:
+	// Place of a loop, the end of the labels of its header, the copies
+	// peeled and the ones repeated
+	struct Plan { int begin, end, labels, peel, factor; };
+};
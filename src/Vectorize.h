@@ -0,0 +1,218 @@
+#pragma once
+#include "Trips.h"
+#include <set>
+
+/*
+	Loop vectorization. A loop of one block with a known trip count whose
+	counter steps over consecutive elements, a[i] = b[i] + c[i] after the
+	products of the counter are reduced, runs width iterations at once:
+	the elements are loaded into the lanes of vector temporaries, added,
+	subtracted or multiplied lane by lane and stored back. The iterations
+	left over by the width follow as scalar copies of the body, and another
+	counter of the loop takes width of its steps at once. A loop
+	storing into an array it also reaches at another offset is left alone,
+	an iteration could read what an earlier one stored
+*/
+class Vectorize {
+public:
+	static const int Width = 4; // Lanes of the vectors
+	static const int Widest = 64; // Lanes accepted at most
+
+	// Returns the number of loops vectorized
+	static int run(Code& code, Analyses& analyses, int width = Width) {
+		if (code.quads.empty() || width < 2) return 0;
+		std::vector<Quad>& quads = code.quads;
+		Trips counters(code, analyses);
+		const CFG& cfg = counters.ssa.cfg;
+		const Loops& nest = counters.nest;
+		Vectorize pass(code, width);
+
+		std::vector<std::vector<Quad> > loops(quads.size()); // Code replacing each loop, by its first instruction
+		std::vector<int> ends(quads.size(), -1);
+		int vectorized = 0;
+		for (int l = 0; l < (int)nest.loops.size(); l++) {
+			const Loops::Loop& loop = nest.loops[l];
+			int h = loop.header;
+			if (loop.blocks.size() != 1 || loop.exits.size() > 1) continue;
+			Trips::Counter counter;
+			if (!counters.count(l, counter) || counter.trips < width) continue;
+			if (!pass.vectorize(cfg.blocks[h].begin, cfg.blocks[h].end, counter, loops[cfg.blocks[h].begin])) continue;
+			ends[cfg.blocks[h].begin] = cfg.blocks[h].end;
+			vectorized++;
+		}
+		if (vectorized == 0) return 0;
+
+		std::vector<Quad> result;
+		for (int i = 0; i < (int)quads.size(); i++) {
+			if (ends[i] < 0) { result.push_back(quads[i]); continue; }
+			result.insert(result.end(), loops[i].begin(), loops[i].end());
+			i = ends[i] - 1;
+		}
+		quads.swap(result);
+		analyses.invalidate(Analyses::Graph);
+		return vectorized;
+	}
+
+private:
+	Code& code;
+	int width;
+	int number = 0;
+
+	Vectorize(Code& c, int w) : code(c), width(w) {
+		for (const Operand& o : code.operands) {
+			if (o.kind == Operand::Temp) number = std::max(number, o.number);
+		}
+	}
+
+	// Vectorizes the loop of the block from begin to end into result,
+	// false if it does not qualify
+	bool vectorize(int begin, int end, const Trips::Counter& counter, std::vector<Quad>& result) {
+		const std::vector<Quad>& quads = code.quads;
+		const Quad& s = quads[counter.stepped];
+		int x = s.dest, labels = begin;
+		while (quads[labels].op == Opcode::Label) labels++;
+		if (s.op != Opcode::Add || (s.src1 != x && s.src2 != x)) return false;
+
+		// Names assigned in the body, read neither before in the body nor
+		// after the loop. Another counter stepped by a constant and read by
+		// nothing else in the body keeps its value after the loop
+		std::map<int, int> assigned, steps;
+		for (int i = labels; i < end - 1; i++) {
+			const Quad& q = quads[i];
+			int c, d = q.def();
+			if (d != x && d != Quad::None && q.op == Opcode::Add && code.operands[d].type == Type::Int && touched(d, labels, end) == 1
+				&& ((q.src1 == d && code.integer(q.src2, c)) || (q.src2 == d && code.integer(q.src1, c)))) {
+				if (!Numbering::fold(Opcode::Mul, c, width, steps[i])) return false;
+				continue;
+			}
+			int u[3], n = q.uses(u);
+			for (int k = 0; k < n; k++) {
+				if (u[k] != x && assigned.count(u[k]) == 0 && defined(u[k], i, end)) return false;
+			}
+			if (d == Quad::None) continue;
+			if (assigned.count(d) > 0 || (d != x && (code.operands[d].kind != Operand::Temp || code.lanes(d) > 0))) return false;
+			assigned[d] = i;
+		}
+		for (int i = 0; i < (int)quads.size(); i++) {
+			if (i >= begin && i < end) continue;
+			int u[3], n = quads[i].uses(u);
+			for (int k = 0; k < n; k++) {
+				if (u[k] != x && assigned.count(u[k]) > 0) return false;
+			}
+		}
+		for (int i = counter.stepped + 1; i < end - 1; i++) {
+			if (steps.count(i) == 0) return false; // Only the other counters follow the step
+		}
+		auto invariant = [&](int y) { return y != Quad::None && y != x && assigned.count(y) == 0; };
+
+		// Offsets of the elements the counter reaches, the counter itself or
+		// its sum with an invariant, and the vectors of the other names
+		std::map<int, int> offsets = { { x, Quad::None } };
+		std::map<int, int> vectors;
+		std::map<int, std::set<int> > reached, stored; // Offsets of each array
+		std::shared_ptr<Type> element;
+		auto operand = [&](int y) { return invariant(y) || vectors.count(y) > 0; };
+		auto of = [&](int y) {
+			if (element == nullptr) element = code.operands[y].type;
+			return element == code.operands[y].type;
+		};
+		for (int i = labels; i < counter.stepped; i++) {
+			const Quad& q = quads[i];
+			if (steps.count(i) > 0) continue;
+			switch (q.op) {
+			case Opcode::Add:
+				if ((q.src1 == x && invariant(q.src2)) || (q.src2 == x && invariant(q.src1))) {
+					offsets[q.dest] = q.src1 == x ? q.src2 : q.src1;
+					continue;
+				}
+				// fall through
+			case Opcode::Sub: case Opcode::Mul:
+				if (!operand(q.src1) || !operand(q.src2) || (invariant(q.src1) && invariant(q.src2)) || !of(q.dest)) return false;
+				vectors[q.dest] = Quad::None;
+				break;
+			case Opcode::Load:
+				if (offsets.count(q.src2) == 0 || !of(q.dest)) return false;
+				reached[q.src1].insert(offsets[q.src2]);
+				vectors[q.dest] = Quad::None;
+				break;
+			case Opcode::Store:
+				if (offsets.count(q.src1) == 0 || !operand(q.src2) || !of(q.src2)) return false;
+				reached[q.dest].insert(offsets[q.src1]);
+				stored[q.dest].insert(offsets[q.src1]);
+				break;
+			default:
+				return false;
+			}
+		}
+
+		// The counter and the offsets are only read to reach elements
+		for (int i = labels; i < counter.stepped; i++) {
+			const Quad& q = quads[i];
+			int u[3], n = q.uses(u);
+			for (int k = 0; k < n; k++) {
+				bool index = (q.op == Opcode::Load && k == 1) || (q.op == Opcode::Store && k == 1);
+				bool offset = q.op == Opcode::Add && u[k] == x && offsets.count(q.dest) > 0;
+				if (offsets.count(u[k]) > 0 && !index && !offset) return false;
+			}
+		}
+		for (auto& array : stored) {
+			if (reached[array.first].size() > 1) return false;
+		}
+		if (element == nullptr || element == Type::Bool || element->width != counter.step) return false;
+		int vectorStep, trips = counter.trips / width, bound, span;
+		if (!Numbering::fold(Opcode::Mul, counter.step, width, vectorStep) || !Numbering::fold(Opcode::Mul, vectorStep, trips, span)
+			|| !Numbering::fold(Opcode::Add, counter.start, span, bound)) return false;
+		std::shared_ptr<Type> type = std::make_shared<Array>(width, element);
+		for (auto& v : vectors) v.second = code.temp(type, ++number);
+
+		// The vector loop, then the iterations left as scalar copies
+		result.assign(quads.begin() + begin, quads.begin() + labels);
+		auto lanes = [&](int y) { return invariant(y) ? y : vectors[y]; };
+		for (int i = labels; i < end - 1; i++) {
+			const Quad& q = quads[i];
+			if (i == counter.stepped) result.push_back(Quad(Opcode::Add, x, x, code.constant(vectorStep)));
+			else if (steps.count(i) > 0) result.push_back(Quad(Opcode::Add, q.dest, q.dest, code.constant(steps[i])));
+			else if (offsets.count(q.dest) > 0 && q.op == Opcode::Add) result.push_back(q);
+			else if (q.op == Opcode::Load) result.push_back(Quad(Opcode::VLoad, vectors[q.dest], q.src1, q.src2));
+			else if (q.op == Opcode::Store) {
+				int v = q.src2;
+				if (invariant(v)) {
+					v = code.temp(type, ++number);
+					result.push_back(Quad(Opcode::VSplat, v, q.src2));
+				}
+				else v = vectors[v];
+				result.push_back(Quad(Opcode::VStore, q.dest, q.src1, v));
+			}
+			else {
+				Opcode op = q.op == Opcode::Add ? Opcode::VAdd : q.op == Opcode::Sub ? Opcode::VSub : Opcode::VMul;
+				result.push_back(Quad(op, vectors[q.dest], lanes(q.src1), lanes(q.src2)));
+			}
+		}
+		Quad test(Opcode::If, Quad::None, x, code.constant(bound));
+		test.rel = Relop::Lt;
+		test.label = quads[end - 1].label;
+		result.push_back(test);
+		for (int k = 0; k < counter.trips % width; k++) result.insert(result.end(), quads.begin() + labels, quads.begin() + end - 1);
+		return true;
+	}
+
+	// Whether x is assigned from instruction i to the end of the body
+	bool defined(int x, int i, int end) const {
+		for (; i < end; i++) {
+			if (code.quads[i].def() == x) return true;
+		}
+		return false;
+	}
+
+	// Number of instructions from begin to end reading or assigning x
+	int touched(int x, int begin, int end) const {
+		int count = 0;
+		for (int i = begin; i < end; i++) {
+			int u[3], n = code.quads[i].uses(u);
+			bool reads = false;
+			for (int k = 0; k < n; k++) reads = reads || u[k] == x;
+			count += reads || code.quads[i].def() == x;
+		}
+		return count;
+	}
+};
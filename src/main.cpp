@@ -1,12 +1,52 @@
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
 #include "Lexer.h"
 #include "Parser.h"
+#include "CFG.h"
+#include "Passes.h"
+#include "SSA.h"
+#include "Stats.h"
+
+// The heap of the whole program is counted here, for the statistics
+std::atomic<size_t> Heap::allocated(0);
+std::atomic<size_t> Heap::allocations(0);
+std::atomic<size_t> Heap::live(0);
+bool Heap::counting = false;
+
+void* operator new(size_t n) { return Heap::allocate(n); }
+void* operator new[](size_t n) { return Heap::allocate(n); }
+void operator delete(void* p) noexcept { Heap::deallocate(p); }
+void operator delete[](void* p) noexcept { Heap::deallocate(p); }
+void operator delete(void* p, size_t) noexcept { Heap::deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { Heap::deallocate(p); }
 
 void printUsage(std::string exec) {
 	std::string filename = exec.substr(exec.find_last_of("/\\") + 1);
 	std::cout <<   "Usage: " << filename << " input_file [options]" << std::endl;
+	std::cout << '\t' << "-O, --optimize" << "\t\t" << "optimize three-address code, as -O2" << std::endl;
+	std::cout << '\t' << "-O0, -O1, -O2" << "\t\t" << "optimize at level 0 for none, 1 for the scalar passes, 2 for all" << std::endl;
+	std::cout << '\t' << "--time-passes" << "\t\t" << "print time and instructions after each pass" << std::endl;
+	std::cout << '\t' << "--bounds-check" << "\t\t" << "check the array accesses not proven in bounds" << std::endl;
+	std::cout << '\t' << "--unroll factor" << "\t\t" << "unroll loops by factor under -O, 1 to " << Unroll::Limit << ", 1 for only short loops" << std::endl;
+	std::cout << '\t' << "--vector width" << "\t\t" << "vectorize loops into width lanes under -O, 1 to " << Vectorize::Widest << ", 1 for none" << std::endl;
+	std::cout << '\t' << "-o, --output filepath" << '\t' << "output three-address code to filepath" << std::endl;
 	std::cout << '\t' << "-j, --json filepath" << '\t' << "output ast to json in filepath" << std::endl;
 	std::cout << '\t' << "-d, --dot filepath" << '\t' << "output ast to dot in filepath" << std::endl;
+	std::cout << '\t' << "--cfg filepath" << "\t\t" << "output control-flow graph to dot in filepath" << std::endl;
+	std::cout << '\t' << "--ssa filepath" << "\t\t" << "output three-address code in SSA form to filepath" << std::endl;
+	std::cout << '\t' << "-s, --stats" << "\t\t" << "print memory and node statistics of each phase" << std::endl;
+	std::cout << '\t' << "--stats-json filepath" << '\t' << "output statistics to json in filepath" << std::endl;
+}
+
+// Reads a whole decimal number from low to high into value
+bool number(const char* s, int low, int high, int& value) {
+	char* end;
+	errno = 0;
+	long n = strtol(s, &end, 10);
+	if (end == s || *end != 0 || errno == ERANGE || n < low || n > high) return false;
+	value = (int)n;
+	return true;
 }
 
 int main(int argc, char* argv[])
@@ -18,11 +58,79 @@ int main(int argc, char* argv[])
 
 	int a = 1;
 	std::shared_ptr<Stmt> ast;
+	Context ctx;
+
+	// Statistics are recorded at the end of each phase
+	Stats stats;
+	bool printStats = false;
+	const char* statsFile = nullptr;
+	const char* outputFile = nullptr;
+	int level = 0;
+	bool boundsCheck = false;
+	bool timePasses = false;
+	int factor = Unroll::Factor;
+	int width = Vectorize::Width;
+	bool bad = false; // Option value out of its range
+	for (int i = 2; i < argc; i++) {
+		bool valued = strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "--stats-json") == 0
+			|| strcmp(argv[i], "--unroll") == 0 || strcmp(argv[i], "--vector") == 0;
+		if (valued && i + 1 == argc) {
+			// The option misses its value
+			std::cout << "Incorrect input!" << std::endl; printUsage(argv[0]);
+			return 0;
+		}
+		if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0) printStats = true;
+		else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0) level = Passes::Levels;
+		else if (strncmp(argv[i], "-O", 2) == 0 && isdigit(argv[i][2]) && argv[i][3] == 0) level = std::min(argv[i][2] - '0', (int)Passes::Levels);
+		else if (strcmp(argv[i], "--time-passes") == 0) timePasses = true;
+		else if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)) outputFile = argv[++i];
+		else if (strcmp(argv[i], "--stats-json") == 0) statsFile = argv[++i];
+		else if (strcmp(argv[i], "--bounds-check") == 0) boundsCheck = true;
+		else if (strcmp(argv[i], "--unroll") == 0) bad = !number(argv[++i], 1, Unroll::Limit, factor);
+		else if (strcmp(argv[i], "--vector") == 0) bad = !number(argv[++i], 1, Vectorize::Widest, width);
+		if (bad) {
+			std::cout << "Incorrect " << argv[i - 1] << " " << argv[i] << "!" << std::endl; printUsage(argv[0]);
+			return 0;
+		}
+	}
+	bool collectStats = printStats || statsFile != nullptr;
+	Heap::counting = collectStats;
 
     try {
 		std::shared_ptr<Lexer> l = std::make_shared<Lexer>(argv[a++]);
 		std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
         ast = p->program();
+		if (collectStats) {
+			// Tokens are scanned on demand of the parser
+			stats.phase("parse");
+			stats.counters["tokens"] = l->tokens;
+			stats.count(ast.get());
+		}
+
+		p->gen(ctx, ast);
+		if (collectStats) {
+			stats.phase("codegen");
+			stats.counters["labels"] = ctx.labels;
+			stats.counters["temporaries"] = ctx.temps;
+			stats.counters["instructions"] = ctx.code.quads.size();
+		}
+
+		// The passes of the optimization level, led by the bounds checks
+		Passes passes(level, boundsCheck, factor, width);
+		passes.run(ctx.code, [&](const std::string& name, const Passes::Counters& counters) {
+			if (!collectStats) return;
+			stats.phase(name);
+			for (auto& c : counters) stats.counters[c.first] = c.second;
+		});
+		if (timePasses) passes.report(std::cerr);
+
+		// The code goes to standard output unless a file is given
+		std::unique_ptr<Sink> out;
+		if (outputFile != nullptr) out = std::make_unique<FileSink>(outputFile);
+		else out = std::make_unique<FileSink>();
+		ctx.code.print(*out);
+		out->flush();
+		if (collectStats) stats.phase("emit");
     }
     catch (std::exception& e) {
 		std::cerr << "Error: " << e.what() << std::endl;
@@ -40,11 +148,11 @@ int main(int argc, char* argv[])
 			}
 
 			// Write AST to json
-			json j = ast->toJson();
 			os.open(argv[a]);
-			if (os.is_open()) os << j.dump();
+			if (os.is_open()) ast->toJson(os);
 			else std::cerr << "Can not open " << argv[a] << std::endl;
 			os.close(); os.clear();
+			if (collectStats) stats.phase("json");
 		}
 
 		if (strcmp(argv[a], "-d") == 0 || strcmp(argv[a], "--dot") == 0) {
@@ -65,10 +173,64 @@ int main(int argc, char* argv[])
 			if (os.is_open()) os << ss.str();
 			else std::cerr << "Can not open " << argv[a] << std::endl;
 			os.close(); os.clear();
+			if (collectStats) stats.phase("dot");
+		}
+
+		if (strcmp(argv[a], "--cfg") == 0) {
+
+			if (argv[a++] == nullptr) {
+				std::cout << "Incorrect input!" << std::endl; printUsage(argv[0]);
+				return 0;
+			}
+
+			// Write control-flow graph of the code to dot
+			CFG cfg(ctx.code);
+			os.open(argv[a]);
+			if (os.is_open()) cfg.toDot(os, ctx.code);
+			else std::cerr << "Can not open " << argv[a] << std::endl;
+			os.close(); os.clear();
+			if (collectStats) {
+				stats.phase("cfg");
+				stats.counters["blocks"] = cfg.blocks.size();
+			}
+		}
+
+		if (strcmp(argv[a], "--ssa") == 0) {
+
+			if (argv[a++] == nullptr) {
+				std::cout << "Incorrect input!" << std::endl; printUsage(argv[0]);
+				return 0;
+			}
+
+			// Write the code in SSA form, the output code is left as it is
+			Code code = ctx.code;
+			SSA ssa(code);
+			try {
+				FileSink out(argv[a]);
+				ssa.print(out);
+				out.flush();
+			}
+			catch (std::exception& e) {
+				std::cerr << e.what() << std::endl;
+			}
+			if (collectStats) {
+				size_t phis = 0;
+				for (auto& b : ssa.phis) phis += b.size();
+				stats.phase("ssa");
+				stats.counters["phis"] = phis;
+			}
 		}
 
 		a++;
 	}
 
+	if (printStats) stats.report(std::cerr);
+	if (statsFile != nullptr) {
+		os.open(statsFile);
+		if (os.is_open()) os << stats.toJson().dump();
+		else std::cerr << "Can not open " << statsFile << std::endl;
+		os.close(); os.clear();
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Parser.h"
+#include "Interpreter.h"
+#include "Passes.h"
+
+/*
+	Check of the optimizations against the interpreter. The program is
+	interpreted as generated and after the passes of the options, and the
+	variables and array elements must end with the same values, with no
+	bounds check failing
+
+	Usage: check input_file [-O0|-O1|-O2] [--bounds-check] [--unroll factor] [--vector width]
+*/
+
+static const size_t Limit = 100000000; // Instructions interpreted at most
+
+static Code generate(const char* input) {
+	Context ctx;
+	std::shared_ptr<Lexer> l = std::make_shared<Lexer>(input);
+	std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
+	p->gen(ctx, p->program());
+	return ctx.code;
+}
+
+// Variables and array elements at the end of a run, with the error of a
+// failed check or of a run stopped at the limit
+struct Result {
+	std::vector<double> values;
+	std::vector<std::string> names;
+	std::string error;
+};
+
+// Runs the code, over the operands it was generated with
+static Result run(const Code& code, size_t operands) {
+	Result result;
+	Interpreter interpreter(code);
+	try {
+		if (!interpreter.run(Limit)) result.error = "stopped after " + std::to_string(Limit) + " instructions";
+	}
+	catch (std::out_of_range& e) {
+		result.error = e.what();
+	}
+	if (!result.error.empty()) return result;
+	for (size_t x = 0; x < operands; x++) {
+		const Operand& o = code.operands[x];
+		if (o.kind != Operand::Var) continue;
+		const Array* array = dynamic_cast<const Array*>(o.type.get());
+		if (array == nullptr) {
+			result.values.push_back(interpreter.value((int)x));
+			result.names.push_back(code.name((int)x));
+			continue;
+		}
+		for (int offset = 0; offset < array->width; offset += Code::element(*array)) {
+			result.values.push_back(interpreter.element((int)x, offset));
+			result.names.push_back(code.name((int)x) + " [ " + std::to_string(offset) + " ]");
+		}
+	}
+	return result;
+}
+
+// Reads a whole decimal number from 1 to high into value
+static bool number(const char* s, int high, int& value) {
+	char* end;
+	errno = 0;
+	long n = strtol(s, &end, 10);
+	if (end == s || *end != 0 || errno == ERANGE || n < 1 || n > high) return false;
+	value = (int)n;
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	int level = Passes::Levels, factor = Unroll::Factor, width = Vectorize::Width;
+	bool bounds = false, usage = argc < 2;
+	for (int i = 2; i < argc && !usage; i++) {
+		if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '2' && argv[i][3] == 0) level = argv[i][2] - '0';
+		else if (strcmp(argv[i], "--bounds-check") == 0) bounds = true;
+		else if (strcmp(argv[i], "--unroll") == 0 && i + 1 < argc) usage = !number(argv[++i], Unroll::Limit, factor);
+		else if (strcmp(argv[i], "--vector") == 0 && i + 1 < argc) usage = !number(argv[++i], Vectorize::Widest, width);
+		else usage = true;
+	}
+	if (usage) {
+		std::cerr << "Usage: check input_file [-O0|-O1|-O2] [--bounds-check] [--unroll factor] [--vector width]" << std::endl;
+		return 2;
+	}
+
+	try {
+		Code plain = generate(argv[1]), optimized = plain;
+		Passes passes(level, bounds, factor, width);
+		passes.run(optimized);
+
+		Result expected = run(plain, plain.operands.size());
+		if (!expected.error.empty()) {
+			std::cerr << argv[1] << ": " << expected.error << std::endl;
+			return 1;
+		}
+		Result got = run(optimized, plain.operands.size());
+		if (!got.error.empty()) {
+			std::cerr << argv[1] << ": " << got.error << " after the passes" << std::endl;
+			return 1;
+		}
+		for (size_t k = 0; k < expected.values.size(); k++) {
+			if (got.values[k] == expected.values[k]) continue;
+			std::cerr << argv[1] << ": " << expected.names[k] << " is " << got.values[k] << " instead of " << expected.values[k] << std::endl;
+			return 1;
+		}
+		std::cout << argv[1] << ": " << expected.values.size() << " values agree" << std::endl;
+	}
+	catch (std::exception& e) {
+		std::cerr << argv[1] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
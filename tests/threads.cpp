@@ -0,0 +1,73 @@
+#include <iostream>
+#include <thread>
+#include "Parser.h"
+#include "Passes.h"
+
+/*
+	Check of concurrent compilations. Each input is compiled once alone,
+	then again by several threads at once, each with its own lexer, parser
+	and context, and every compilation must print the same code. Built
+	with -fsanitize=thread the run also reports the state the threads
+	would share without synchronization
+
+	Usage: threads input_file...
+*/
+
+static const int Threads = 8; // Threads compiling at once
+static const int Rounds = 20; // Compilations of each input by each thread
+
+// Code of the input at the optimization level
+static std::string compile(const char* input, int level) {
+	Context ctx;
+	std::shared_ptr<Lexer> l = std::make_shared<Lexer>(input);
+	std::shared_ptr<Parser> p = std::make_shared<Parser>(l);
+	p->gen(ctx, p->program());
+	Passes passes(level, false);
+	passes.run(ctx.code);
+	MemorySink out;
+	ctx.code.print(out);
+	return out.str();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: threads input_file..." << std::endl;
+		return 2;
+	}
+
+	std::vector<std::string> expected;
+	try {
+		for (int a = 1; a < argc; a++) {
+			for (int level = 0; level <= Passes::Levels; level++) expected.push_back(compile(argv[a], level));
+		}
+	}
+	catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::vector<int> mismatches(Threads, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; t++) {
+		threads.emplace_back([&, t] {
+			for (int r = 0; r < Rounds; r++) {
+				size_t k = 0;
+				for (int a = 1; a < argc; a++) {
+					for (int level = 0; level <= Passes::Levels; level++, k++) {
+						if (compile(argv[a], level) != expected[k]) mismatches[t]++;
+					}
+				}
+			}
+		});
+	}
+	for (std::thread& t : threads) t.join();
+
+	int total = 0;
+	for (int m : mismatches) total += m;
+	if (total > 0) {
+		std::cerr << total << " compilations differ from the sequential ones" << std::endl;
+		return 1;
+	}
+	std::cout << Threads * Rounds * expected.size() << " compilations agree" << std::endl;
+	return 0;
+}